@@ -0,0 +1,216 @@
+// deterministic directory tree for the end-to-end benchmarks: the same options and seed
+// give the same names on every machine, so timings of different commits compare
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// same generator as match_bench
+struct Random {
+    uint64_t state;
+
+    explicit Random(uint64_t seed) : state(seed == 0 ? 1 : seed) {}
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    size_t below(size_t limit) { return next() % limit; }
+};
+
+struct Options {
+    size_t fanOut = 6;       // subdirectories per directory
+    size_t depth = 4;        // directory levels below the root
+    size_t files = 20;       // files per directory
+    size_t minLength = 4;    // name lengths without extension, skewed towards short names
+    size_t maxLength = 24;
+    size_t symlinkPercent = 2; // of the directories also get a symlink to a sibling
+    size_t flat = 0;         // > 0: a single directory with this many files instead of a tree
+    uint64_t seed = 42;
+};
+
+struct Counts {
+    size_t directories = 0;
+    size_t files = 0;
+    size_t symlinks = 0;
+    size_t needles = 0;
+};
+
+const char* const extensions[] = {"", ".c", ".h", ".cpp", ".js", ".json", ".txt", ".md", ".so", ".py", ".o", ".html"};
+
+std::string randomName(const Options& options, Random& random) {
+    static const char characters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+    // the smaller of two draws: most names are short, a few are long
+    size_t range = options.maxLength - options.minLength + 1;
+    size_t size = options.minLength + std::min(random.below(range), random.below(range));
+    std::string name;
+    for (size_t i = 0; i < size; ++i) {
+        name += characters[random.below(sizeof(characters) - 1)];
+    }
+    name += extensions[random.below(sizeof(extensions) / sizeof(extensions[0]))];
+    return name;
+}
+
+bool createFile(const std::string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return errno == EEXIST;
+    }
+    close(fd);
+    return true;
+}
+
+// files of one directory; about one directory in a hundred holds "needle.txt" for the
+// benchmark searches, and "needle-<i>.txt" are spread over the tree once each
+bool fillDirectory(const std::string& directory, size_t files, const Options& options, Random& random,
+                   size_t& nextNeedle, Counts& counts) {
+    for (size_t i = 0; i < files; ++i) {
+        if (!createFile(directory + "/" + randomName(options, random))) {
+            return false;
+        }
+        ++counts.files;
+    }
+    if (random.below(100) == 0 || counts.directories == 1) {
+        createFile(directory + "/needle.txt");
+        ++counts.needles;
+    }
+    if (nextNeedle < 16 && random.below(16) == 0) {
+        createFile(directory + "/needle-" + std::to_string(nextNeedle++) + ".txt");
+    }
+    return true;
+}
+
+bool makeTree(const std::string& directory, size_t level, const Options& options, Random& random,
+              size_t& nextNeedle, Counts& counts) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Error: cannot create " << directory << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    ++counts.directories;
+    if (!fillDirectory(directory, options.files, options, random, nextNeedle, counts)) {
+        std::cerr << "Error: cannot create files in " << directory << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    if (level == options.depth) {
+        return true;
+    }
+    std::vector<std::string> children;
+    for (size_t i = 0; i < options.fanOut; ++i) {
+        children.push_back("d" + std::to_string(i) + "-" + randomName(options, random));
+        if (!makeTree(directory + "/" + children.back(), level + 1, options, random, nextNeedle, counts)) {
+            return false;
+        }
+    }
+    // links to siblings: -L sees the subtree twice and has to skip it the second time
+    for (const auto& child : children) {
+        if (random.below(100) < options.symlinkPercent) {
+            const std::string& target = children[random.below(children.size())];
+            if (symlink(target.c_str(), (directory + "/link-" + child).c_str()) == 0) {
+                ++counts.symlinks;
+            }
+        }
+    }
+    return true;
+}
+
+bool parseSize(const char* text, size_t& value) {
+    char* end = nullptr;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*text == '\0' || *end != '\0') {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [-f fan-out] [-d depth] [-n files] [-l min:max] [-s percent] [-x files] [-S seed] directory\n"
+              << "Options:\n"
+              << "  -f  Subdirectories per directory (default 6)\n"
+              << "  -d  Directory levels below directory (default 4)\n"
+              << "  -n  Files per directory (default 20)\n"
+              << "  -l  Name lengths without extension, mostly short (default 4:24)\n"
+              << "  -s  Percent of directories that also get a symlink to a sibling (default 2)\n"
+              << "  -x  One flat directory with this many files instead of a tree\n"
+              << "  -S  Seed of the name generator (default 42)\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    bool valid = true;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:d:n:l:s:x:S:")) != EOF) {
+        switch (opt) {
+            case 'f':
+                valid = parseSize(optarg, options.fanOut) && valid;
+                break;
+            case 'd':
+                valid = parseSize(optarg, options.depth) && valid;
+                break;
+            case 'n':
+                valid = parseSize(optarg, options.files) && valid;
+                break;
+            case 'l': {
+                std::string range(optarg);
+                size_t colon = range.find(':');
+                valid = colon != std::string::npos && parseSize(range.substr(0, colon).c_str(), options.minLength)
+                        && parseSize(range.substr(colon + 1).c_str(), options.maxLength)
+                        && options.minLength >= 1 && options.minLength <= options.maxLength && options.maxLength <= 200
+                        && valid;
+                break;
+            }
+            case 's':
+                valid = parseSize(optarg, options.symlinkPercent) && options.symlinkPercent <= 100 && valid;
+                break;
+            case 'x':
+                valid = parseSize(optarg, options.flat) && valid;
+                break;
+            case 'S': {
+                size_t seed = 0;
+                valid = parseSize(optarg, seed) && valid;
+                options.seed = seed;
+                break;
+            }
+            default:
+                valid = false;
+                break;
+        }
+    }
+    if (!valid || optind + 1 != argc) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const std::string root = argv[optind];
+    Random random(options.seed);
+    Counts counts;
+    size_t nextNeedle = 0;
+    if (options.flat > 0) {
+        if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Error: cannot create " << root << ": " << strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+        counts.directories = 1;
+        if (!fillDirectory(root, options.flat, options, random, nextNeedle, counts)) {
+            std::cerr << "Error: cannot create files in " << root << ": " << strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+    } else if (!makeTree(root, 0, options, random, nextNeedle, counts)) {
+        return EXIT_FAILURE;
+    }
+    std::cout << root << ": " << counts.directories << " directories, " << counts.files << " files, "
+              << counts.symlinks << " symlinks, " << counts.needles << " needle.txt\n";
+    return 0;
+}
@@ -0,0 +1,262 @@
+// microbenchmark for the filename matchers, isolated from any I/O: every strategy (exact
+// names with and without -i, globs, --contains and --regex) runs over the same corpus of
+// filenames, read from a file or generated, and reports ns per name and GB/s of names.
+// --contains is also checked against testing every pattern on every name
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "../match.hpp"
+
+namespace {
+
+// deterministic, so runs on different commits see the same corpus
+struct Random {
+    uint64_t state;
+
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    size_t below(size_t limit) { return next() % limit; }
+};
+
+std::vector<std::string> generateNames(size_t count, Random& random) {
+    static const char characters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+    static const char* extensions[] = {"", ".c", ".h", ".cpp", ".js", ".json", ".txt", ".md", ".so", ".py"};
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string name;
+        size_t size = 3 + random.below(6) + random.below(14);
+        for (size_t j = 0; j < size; ++j) {
+            name += characters[random.below(sizeof(characters) - 1)];
+        }
+        name += extensions[random.below(sizeof(extensions) / sizeof(extensions[0]))];
+        names.push_back(std::move(name));
+    }
+    return names;
+}
+
+// one filename or path per line, only the last component is used
+std::vector<std::string> readNames(const char* file) {
+    std::ifstream in(file);
+    std::vector<std::string> names;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t slash = line.rfind('/');
+        if (slash != std::string::npos) {
+            line.erase(0, slash + 1);
+        }
+        if (!line.empty()) {
+            names.push_back(line);
+        }
+    }
+    return names;
+}
+
+// substrings of random corpus names, like fragments from a feed
+std::vector<std::string> pickFragments(const std::vector<std::string>& names, size_t count, Random& random) {
+    std::vector<std::string> fragments;
+    while (fragments.size() < count) {
+        const std::string& name = names[random.below(names.size())];
+        size_t size = std::min<size_t>(name.size(), 4 + random.below(5));
+        fragments.push_back(name.substr(random.below(name.size() - size + 1), size));
+    }
+    return fragments;
+}
+
+// whole names: half of them occur in the corpus, half are new
+std::vector<std::string> pickNames(const std::vector<std::string>& names, size_t count, Random& random) {
+    std::vector<std::string> picked;
+    std::vector<std::string> invented = generateNames(count / 2, random);
+    while (picked.size() < count - invented.size()) {
+        picked.push_back(names[random.below(names.size())]);
+    }
+    picked.insert(picked.end(), invented.begin(), invented.end());
+    return picked;
+}
+
+// "*fragment*", "fragment*.json" and "*.ext" in turn
+std::vector<std::string> makeGlobs(const std::vector<std::string>& fragments) {
+    static const char* extensions[] = {"c", "h", "json", "md", "py"};
+    std::vector<std::string> globs;
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        switch (i % 3) {
+            case 0: globs.push_back("*" + fragments[i] + "*"); break;
+            case 1: globs.push_back(fragments[i] + "*.json"); break;
+            default: globs.push_back(std::string("*.") + extensions[i % 5]); break;
+        }
+    }
+    return globs;
+}
+
+// "fragment.*\.(json|md)$", "^fragment[a-z0-9_]+" and one without a required literal, so
+// the DFA runs and not only the prefilter; '.' in fragments escaped
+std::vector<std::string> makeRegexes(const std::vector<std::string>& fragments) {
+    std::vector<std::string> regexes;
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        std::string literal;
+        for (char c : fragments[i]) {
+            if (c == '.') {
+                literal += '\\';
+            }
+            literal += c;
+        }
+        switch (i % 3) {
+            case 0: regexes.push_back(literal + ".*\\.(json|md)$"); break;
+            case 1: regexes.push_back("^" + literal + "[a-z0-9_]+"); break;
+            default: regexes.push_back("[0-9]{2}[a-z_]*\\.(c|h|cpp)$"); break;
+        }
+    }
+    return regexes;
+}
+
+struct Result {
+    double seconds;
+    size_t matches;
+};
+
+// best of several rounds, the callback returns the number of (name, pattern) matches
+Result measure(const std::function<size_t()>& run, int rounds) {
+    Result best{1e30, 0};
+    for (int round = 0; round < rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        size_t matches = run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < best.seconds) {
+            best = Result{seconds, matches};
+        }
+    }
+    return best;
+}
+
+// every name through matcher
+Result measureMatcher(const NameMatcher& matcher, const std::vector<std::string>& names, int rounds) {
+    return measure([&] {
+        size_t matches = 0;
+        for (const auto& name : names) {
+            matcher.forEachMatch(name, [&](size_t) { ++matches; });
+        }
+        return matches;
+    }, rounds);
+}
+
+void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [-i] [-n patterns] [-p patterns] [-e entries] [-r rounds] [corpus-file]\n"
+              << "Options:\n"
+              << "  -i  Case-insensitive globs, substrings and regexes\n"
+              << "  -n  Number of substring patterns (default 500)\n"
+              << "  -p  Number of exact, glob and regex patterns (default 8)\n"
+              << "  -e  Number of generated filenames without corpus-file (default 200000)\n"
+              << "  -r  Rounds per strategy, the best one is reported (default 5)\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    bool ignoreCase = false;
+    size_t patternCount = 500;
+    size_t otherCount = 8;
+    size_t entryCount = 200000;
+    int rounds = 5;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "in:p:e:r:")) != EOF) {
+        switch (opt) {
+            case 'i':
+                ignoreCase = true;
+                break;
+            case 'n':
+                patternCount = strtoul(optarg, nullptr, 10);
+                break;
+            case 'p':
+                otherCount = strtoul(optarg, nullptr, 10);
+                break;
+            case 'e':
+                entryCount = strtoul(optarg, nullptr, 10);
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    Random random(42);
+    std::vector<std::string> names = optind < argc ? readNames(argv[optind]) : generateNames(entryCount, random);
+    if (names.empty() || patternCount == 0 || otherCount == 0 || rounds <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> patterns = pickFragments(names, patternCount, random);
+
+    // naive: every pattern against every name, names folded up front with -i
+    std::vector<std::string> foldedPatterns;
+    for (const auto& pattern : patterns) {
+        foldedPatterns.push_back(ignoreCase ? foldCase(pattern) : pattern);
+    }
+    Result naive = measure([&] {
+        size_t matches = 0;
+        std::string folded;
+        for (const auto& name : names) {
+            const std::string* subject = &name;
+            if (ignoreCase) {
+                folded = foldCase(name);
+                subject = &folded;
+            }
+            for (const auto& pattern : foldedPatterns) {
+                matches += subject->find(pattern) != std::string::npos;
+            }
+        }
+        return matches;
+    }, rounds);
+
+    auto compileStart = std::chrono::steady_clock::now();
+    NameMatcher matcher(patterns, ignoreCase, MatchMode::Contains);
+    double compileSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - compileStart).count();
+    Result automaton = measureMatcher(matcher, names, rounds);
+
+    std::vector<std::string> exactNames = pickNames(names, otherCount, random);
+    std::vector<std::string> fragments = pickFragments(names, otherCount, random);
+    NameMatcher exact(exactNames, false);
+    NameMatcher exactFolded(exactNames, true);
+    NameMatcher globs(makeGlobs(fragments), ignoreCase);
+    NameMatcher regexes(makeRegexes(fragments), ignoreCase, MatchMode::Regex);
+
+    size_t bytes = 0;
+    for (const auto& name : names) {
+        bytes += name.size();
+    }
+    std::cout << names.size() << " names (" << bytes << " bytes), " << patterns.size() << " substrings, "
+              << otherCount << " exact/glob/regex patterns" << (ignoreCase ? ", -i" : "") << "\n";
+    auto report = [&](const char* strategy, const Result& result) {
+        std::cout << "  " << strategy << ": " << result.seconds * 1e9 / names.size() << " ns/entry, "
+                  << bytes / result.seconds / 1e9 << " GB/s, " << result.matches << " matches\n";
+    };
+    report("exact         ", measureMatcher(exact, names, rounds));
+    report("exact -i      ", measureMatcher(exactFolded, names, rounds));
+    report("glob          ", measureMatcher(globs, names, rounds));
+    report("substring loop", naive);
+    report("aho-corasick  ", automaton);
+    report("regex         ", measureMatcher(regexes, names, rounds));
+    std::cout << "  automaton compiled in " << compileSeconds * 1e3 << " ms\n";
+
+    if (naive.matches != automaton.matches) {
+        std::cerr << "Error: strategies disagree on the number of matches\n";
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
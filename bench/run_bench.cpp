@@ -0,0 +1,253 @@
+// end-to-end benchmark: runs myfind over generated trees (see make_tree.cpp) in several
+// scenarios and reports wall time percentiles, peak RSS and the walk counters of
+// --stats=json, as one JSON document on stdout that can be diffed between commits; the
+// counters are what the walker counted itself (directories opened, directory reads, stat
+// calls), not syscalls traced from outside
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Scenario {
+    const char* name;
+    const char* tree; // "tree" or "flat", below the work directory
+    std::vector<std::string> options;
+    std::vector<std::string> patterns;
+};
+
+// one run of myfind
+struct Sample {
+    double seconds = 0;
+    long peakRssKiB = 0;
+    // summed over the --stats=json objects of all search processes
+    uint64_t directories = 0;
+    uint64_t entries = 0;
+    uint64_t statCalls = 0;
+    uint64_t directoryReads = 0;
+    uint64_t matches = 0;
+    bool ok = false;
+};
+
+std::vector<Scenario> scenarios() {
+    std::vector<std::string> manyNames;
+    for (int i = 0; i < 16; ++i) {
+        manyNames.push_back("needle-" + std::to_string(i) + ".txt");
+    }
+    return {
+        {"single-name", "tree", {"-R", "-s"}, {"needle.txt"}},
+        {"many-names", "tree", {"-R", "-s"}, manyNames},
+        {"case-insensitive", "tree", {"-R", "-s", "-i"}, {"NEEDLE.TXT"}},
+        {"glob", "tree", {"-R", "-s"}, {"*.json"}},
+        {"four-threads", "tree", {"-R", "-j", "4"}, {"needle.txt"}},
+        {"process-per-name", "tree", {"-R"}, {"needle.txt", "needle-0.txt", "needle-1.txt", "needle-2.txt"}},
+        {"not-recursive", "tree", {"-s"}, {"needle.txt"}},
+        {"follow-symlinks", "tree", {"-R", "-s", "-L"}, {"needle.txt"}},
+        {"huge-flat-directory", "flat", {"-s"}, {"needle.txt"}},
+    };
+}
+
+// run program with arguments, stdout to /dev/null; false if it could not be started or failed
+bool runProgram(const std::vector<std::string>& arguments, std::string* errorOutput, struct rusage* usage) {
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(pipeFds[1], STDERR_FILENO);
+        std::vector<char*> argv;
+        for (const auto& argument : arguments) {
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(pipeFds[1]);
+    std::string output;
+    char buffer[64 * 1024];
+    for (;;) {
+        ssize_t bytes = read(pipeFds[0], buffer, sizeof(buffer));
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            break;
+        }
+        output.append(buffer, bytes);
+    }
+    close(pipeFds[0]);
+    int status = 0;
+    struct rusage childUsage;
+    while (wait4(pid, &status, 0, &childUsage) < 0 && errno == EINTR) {
+    }
+    if (errorOutput != nullptr) {
+        *errorOutput = std::move(output);
+    }
+    if (usage != nullptr) {
+        *usage = childUsage;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// value of the first "key": in line, the process total in a --stats=json object
+uint64_t jsonNumber(const std::string& line, const char* key) {
+    std::string quoted = std::string("\"") + key + "\":";
+    size_t position = line.find(quoted);
+    return position == std::string::npos ? 0 : strtoull(line.c_str() + position + quoted.size(), nullptr, 10);
+}
+
+Sample runScenario(const std::string& myfind, const std::string& workDirectory, const Scenario& scenario) {
+    std::vector<std::string> arguments{myfind, "--no-daemon", "--stats=json"};
+    arguments.insert(arguments.end(), scenario.options.begin(), scenario.options.end());
+    arguments.push_back(workDirectory + "/" + scenario.tree);
+    arguments.insert(arguments.end(), scenario.patterns.begin(), scenario.patterns.end());
+
+    Sample sample;
+    std::string errorOutput;
+    struct rusage usage;
+    auto start = std::chrono::steady_clock::now();
+    sample.ok = runProgram(arguments, &errorOutput, &usage);
+    sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // the largest of myfind and the children it waited for
+    sample.peakRssKiB = usage.ru_maxrss;
+
+    std::istringstream lines(errorOutput);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("{\"pid\":", 0) != 0) {
+            continue;
+        }
+        sample.directories += jsonNumber(line, "directories");
+        sample.entries += jsonNumber(line, "entries");
+        sample.statCalls += jsonNumber(line, "statCalls");
+        sample.directoryReads += jsonNumber(line, "directoryReads");
+        sample.matches += jsonNumber(line, "matches");
+    }
+    return sample;
+}
+
+// value at fraction of the sorted samples, nearest rank
+double percentile(std::vector<double> values, double fraction) {
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(fraction * values.size() + 0.999999);
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+bool exists(const std::string& path) {
+    struct stat status;
+    return stat(path.c_str(), &status) == 0;
+}
+
+void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [-m myfind] [-g make_tree] [-w directory] [-r runs] [scenario]...\n"
+              << "Options:\n"
+              << "  -m  myfind binary to measure (default ./myfind)\n"
+              << "  -g  Tree generator (default ./bench/make_tree)\n"
+              << "  -w  Where the trees are generated, reused if they exist (default /tmp/myfind-bench)\n"
+              << "  -r  Measured runs per scenario after one warm-up run (default 7)\n"
+              << "Scenarios:";
+    for (const auto& scenario : scenarios()) {
+        std::cerr << " " << scenario.name;
+    }
+    std::cerr << "\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string myfind = "./myfind";
+    std::string generator = "./bench/make_tree";
+    std::string workDirectory = "/tmp/myfind-bench";
+    int runs = 7;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:g:w:r:")) != EOF) {
+        switch (opt) {
+            case 'm':
+                myfind = optarg;
+                break;
+            case 'g':
+                generator = optarg;
+                break;
+            case 'w':
+                workDirectory = optarg;
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    std::vector<std::string> selected(argv + optind, argv + argc);
+    if (runs <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the trees are generated once and reused, which also keeps them in the page cache
+    if (mkdir(workDirectory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Error: cannot create " << workDirectory << ": " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    const std::vector<std::vector<std::string>> trees{
+        {generator, workDirectory + "/tree"},
+        {generator, "-x", "100000", workDirectory + "/flat"},
+    };
+    for (const auto& tree : trees) {
+        if (!exists(tree.back()) && !runProgram(tree, nullptr, nullptr)) {
+            std::cerr << "Error: " << generator << " could not generate " << tree.back() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "{\"runs\":" << runs << ",\"scenarios\":[";
+    bool first = true;
+    for (const auto& scenario : scenarios()) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), scenario.name) == selected.end()) {
+            continue;
+        }
+        runScenario(myfind, workDirectory, scenario); // warm-up
+        std::vector<double> seconds;
+        Sample last;
+        long peakRssKiB = 0;
+        for (int run = 0; run < runs; ++run) {
+            last = runScenario(myfind, workDirectory, scenario);
+            if (!last.ok) {
+                std::cerr << "Error: " << myfind << " failed in scenario " << scenario.name << "\n";
+                return EXIT_FAILURE;
+            }
+            seconds.push_back(last.seconds);
+            peakRssKiB = std::max(peakRssKiB, last.peakRssKiB);
+        }
+        std::cout << (first ? "\n" : ",\n") << "{\"name\":\"" << scenario.name << "\",\"medianSeconds\":"
+                  << percentile(seconds, 0.5) << ",\"p95Seconds\":" << percentile(seconds, 0.95)
+                  << ",\"minSeconds\":" << percentile(seconds, 0) << ",\"peakRssKiB\":" << peakRssKiB
+                  << ",\"directories\":" << last.directories << ",\"entries\":" << last.entries
+                  << ",\"matches\":" << last.matches << ",\"walkCounters\":{\"directoriesOpened\":" << last.directories
+                  << ",\"directoryReads\":" << last.directoryReads << ",\"statCalls\":" << last.statCalls << "}}";
+        std::cout.flush();
+        first = false;
+    }
+    std::cout << "\n]}\n";
+    return 0;
+}
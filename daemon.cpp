@@ -0,0 +1,653 @@
+#include "daemon.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "index.hpp"
+
+namespace {
+
+constexpr char requestMagic[] = "MYFIND1";
+
+// how long a client may take to send its request and to take the answer, and the longest
+// request the daemon reads
+constexpr auto clientTimeout = std::chrono::seconds(1);
+constexpr size_t maxRequestSize = 1 << 20;
+// how long a search waits for each part of the daemon's answer before it walks the tree
+constexpr auto queryTimeout = std::chrono::milliseconds(300);
+
+constexpr uint32_t watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                             | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+std::string foldName(std::string_view name) {
+    std::string folded(name);
+    for (char& c : folded) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return folded;
+}
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool fillAddress(const std::string& socketPath, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return true;
+}
+
+struct Node {
+    Node* parent = nullptr;
+    std::string name;
+    bool isDirectory = false;
+    int watch = -1;
+    size_t slot = 0; // position in the name index
+    std::unordered_map<std::string, std::unique_ptr<Node>> children;
+};
+
+// the whole tree below the root with an index from case-folded name to nodes
+class NameTree {
+public:
+    NameTree(std::string rootPath, int inotifyFd) : rootPath(std::move(rootPath)), inotifyFd(inotifyFd) {
+        root.isDirectory = true;
+    }
+
+    // drop everything and read the tree again
+    void rescan();
+    void handleEvent(const inotify_event& event);
+
+    // directory at path relative to the root, nullptr if it is not known
+    Node* findDirectory(std::string_view relativePath);
+    void query(Node* base, const std::vector<std::string>& names, bool recursive, bool ignoreCase,
+               const std::function<void(size_t nameIndex, const Node* node)>& visitor) const;
+    // path of node relative to base, which is one of its ancestors
+    static std::string relativePath(const Node* node, const Node* base);
+
+    size_t size() const { return nodeCount; }
+    size_t watched() const { return watches.size(); }
+
+private:
+    std::string path(const Node* node) const;
+    void scanDirectory(Node* directory, const std::string& directoryPath);
+    // returns the node and whether it was created
+    std::pair<Node*, bool> addEntry(Node* directory, std::string_view name, bool isDirectory);
+    void removeEntry(Node* directory, const std::string& name);
+    void forget(Node* node);
+
+    std::string rootPath;
+    int inotifyFd;
+    Node root;
+    size_t nodeCount = 0;
+    bool watchLimitReported = false;
+    std::unordered_map<int, Node*> watches;
+    std::unordered_map<std::string, std::vector<Node*>> byName;
+};
+
+std::string NameTree::path(const Node* node) const {
+    std::vector<const std::string*> names;
+    for (; node != &root; node = node->parent) {
+        names.push_back(&node->name);
+    }
+    std::string result = rootPath;
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+        if (result.back() != '/') {
+            result += '/';
+        }
+        result += **it;
+    }
+    return result;
+}
+
+std::string NameTree::relativePath(const Node* node, const Node* base) {
+    std::vector<const std::string*> names;
+    for (; node != base; node = node->parent) {
+        names.push_back(&node->name);
+    }
+    std::string result;
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+        if (!result.empty()) {
+            result += '/';
+        }
+        result += **it;
+    }
+    return result;
+}
+
+void NameTree::rescan() {
+    for (auto& child : root.children) {
+        forget(child.second.get());
+    }
+    root.children.clear();
+    if (root.watch >= 0) {
+        inotify_rm_watch(inotifyFd, root.watch);
+        watches.erase(root.watch);
+        root.watch = -1;
+    }
+    scanDirectory(&root, rootPath);
+}
+
+void NameTree::scanDirectory(Node* directory, const std::string& directoryPath) {
+    // watch first, so nothing created while the directory is read gets lost
+    if (directory->watch < 0) {
+        int watch = inotify_add_watch(inotifyFd, directoryPath.c_str(), watchMask);
+        if (watch >= 0) {
+            directory->watch = watch;
+            watches[watch] = directory;
+        } else if (errno == ENOSPC && !watchLimitReported) {
+            std::cerr << "myfind: inotify watch limit reached, some directories are not kept up to date "
+                         "(raise fs.inotify.max_user_watches)\n";
+            watchLimitReported = true;
+        }
+    }
+
+    DIR* stream = opendir(directoryPath.c_str());
+    if (stream == nullptr) {
+        return;
+    }
+    std::vector<Node*> subdirectories;
+    while (dirent* entry = readdir(stream)) {
+        std::string_view name(entry->d_name);
+        if (name == "." || name == "..") {
+            continue;
+        }
+        bool isDirectory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat status;
+            isDirectory = fstatat(dirfd(stream), entry->d_name, &status, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(status.st_mode);
+        }
+        auto added = addEntry(directory, name, isDirectory);
+        if (added.second && isDirectory) {
+            subdirectories.push_back(added.first);
+        }
+    }
+    closedir(stream);
+
+    for (Node* subdirectory : subdirectories) {
+        std::string subdirectoryPath = directoryPath;
+        if (subdirectoryPath.back() != '/') {
+            subdirectoryPath += '/';
+        }
+        subdirectoryPath += subdirectory->name;
+        scanDirectory(subdirectory, subdirectoryPath);
+    }
+}
+
+std::pair<Node*, bool> NameTree::addEntry(Node* directory, std::string_view name, bool isDirectory) {
+    std::string key(name);
+    auto existing = directory->children.find(key);
+    if (existing != directory->children.end()) {
+        if (existing->second->isDirectory == isDirectory) {
+            return {existing->second.get(), false};
+        }
+        // replaced by an entry of the other kind while events were pending
+        removeEntry(directory, key);
+    }
+
+    auto node = std::make_unique<Node>();
+    node->parent = directory;
+    node->name = key;
+    node->isDirectory = isDirectory;
+    std::vector<Node*>& sameName = byName[foldName(name)];
+    node->slot = sameName.size();
+    sameName.push_back(node.get());
+    ++nodeCount;
+
+    Node* added = node.get();
+    directory->children.emplace(std::move(key), std::move(node));
+    return {added, true};
+}
+
+void NameTree::removeEntry(Node* directory, const std::string& name) {
+    auto it = directory->children.find(name);
+    if (it == directory->children.end()) {
+        return;
+    }
+    forget(it->second.get());
+    directory->children.erase(it);
+}
+
+// take node and everything below it out of the name index and stop watching it
+void NameTree::forget(Node* node) {
+    for (auto& child : node->children) {
+        forget(child.second.get());
+    }
+    if (node->watch >= 0) {
+        inotify_rm_watch(inotifyFd, node->watch);
+        watches.erase(node->watch);
+        node->watch = -1;
+    }
+
+    auto sameName = byName.find(foldName(node->name));
+    std::vector<Node*>& nodes = sameName->second;
+    nodes[node->slot] = nodes.back();
+    nodes[node->slot]->slot = node->slot;
+    nodes.pop_back();
+    if (nodes.empty()) {
+        byName.erase(sameName);
+    }
+    --nodeCount;
+}
+
+void NameTree::handleEvent(const inotify_event& event) {
+    if (event.mask & IN_Q_OVERFLOW) {
+        std::cerr << "myfind: inotify queue overflowed, rescanning " << rootPath << "\n";
+        rescan();
+        return;
+    }
+
+    auto watched = watches.find(event.wd);
+    if (watched == watches.end()) {
+        return; // directory was removed from the tree already
+    }
+    Node* directory = watched->second;
+
+    if (event.mask & (IN_IGNORED | IN_DELETE_SELF)) {
+        watches.erase(watched);
+        directory->watch = -1;
+        return;
+    }
+    if (event.len == 0) {
+        return;
+    }
+
+    std::string name(event.name);
+    bool isDirectory = (event.mask & IN_ISDIR) != 0;
+    if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+        auto added = addEntry(directory, name, isDirectory);
+        if (added.second && isDirectory) {
+            // a directory moved in arrives with all its contents
+            scanDirectory(added.first, path(added.first));
+        }
+    } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+        removeEntry(directory, name);
+    }
+}
+
+Node* NameTree::findDirectory(std::string_view relativePath) {
+    Node* node = &root;
+    while (!relativePath.empty()) {
+        size_t slash = relativePath.find('/');
+        std::string name(relativePath.substr(0, slash));
+        relativePath = slash == std::string_view::npos ? std::string_view() : relativePath.substr(slash + 1);
+
+        auto child = node->children.find(name);
+        if (child == node->children.end() || !child->second->isDirectory) {
+            return nullptr;
+        }
+        node = child->second.get();
+    }
+    return node;
+}
+
+void NameTree::query(Node* base, const std::vector<std::string>& names, bool recursive, bool ignoreCase,
+                     const std::function<void(size_t nameIndex, const Node* node)>& visitor) const {
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto sameName = byName.find(foldName(names[i]));
+        if (sameName == byName.end()) {
+            continue;
+        }
+        for (const Node* node : sameName->second) {
+            if (!ignoreCase && node->name != names[i]) {
+                continue;
+            }
+            bool below = node->parent == base;
+            if (recursive) {
+                for (const Node* ancestor = node->parent; ancestor != nullptr && !below; ancestor = ancestor->parent) {
+                    below = ancestor == base;
+                }
+            }
+            if (below) {
+                visitor(i, node);
+            }
+        }
+    }
+}
+
+// a connection whose request is still coming in; the daemon never blocks on one
+struct Client {
+    int fd;
+    std::string request;
+    std::chrono::steady_clock::time_point deadline; // dropped if the request is not complete by then
+};
+
+// answer the complete request of client
+void serveClient(int client, const std::string& request, NameTree& tree, const std::string& rootPath) {
+    std::vector<std::string> fields;
+    for (size_t start = 0; start < request.size();) {
+        size_t end = request.find('\0', start);
+        if (end == std::string::npos) {
+            break;
+        }
+        fields.push_back(request.substr(start, end - start));
+        start = end + 1;
+    }
+    if (fields.size() < 3 || fields[0] != requestMagic) {
+        sendAll(client, "NO bad request\n", 15);
+        return;
+    }
+
+    const std::string& flags = fields[1];
+    const std::string& base = fields[2];
+    std::vector<std::string> names(fields.begin() + 3, fields.end());
+
+    std::string rootPrefix = rootPath == "/" ? rootPath : rootPath + "/";
+    if (base != rootPath && base.compare(0, rootPrefix.size(), rootPrefix) != 0) {
+        std::string answer = "NO not below " + rootPath + "\n";
+        sendAll(client, answer.data(), answer.size());
+        return;
+    }
+    Node* baseNode = tree.findDirectory(base == rootPath ? std::string_view() : std::string_view(base).substr(rootPrefix.size()));
+    if (baseNode == nullptr) {
+        sendAll(client, "NO unknown directory\n", 21);
+        return;
+    }
+
+    std::string answer = "OK\n";
+    bool connected = true;
+    tree.query(baseNode, names, flags.find('R') != std::string::npos, flags.find('i') != std::string::npos,
+               [&](size_t nameIndex, const Node* node) {
+        answer += std::to_string(nameIndex);
+        answer += '\0';
+        answer += NameTree::relativePath(node, baseNode);
+        answer += '\0';
+        if (answer.size() >= 64 * 1024 && connected) {
+            connected = sendAll(client, answer.data(), answer.size());
+            answer.clear();
+        }
+    });
+    if (connected) {
+        sendAll(client, answer.data(), answer.size());
+    }
+}
+
+}
+
+std::string defaultSocketPath() {
+    const char* runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDirectory != nullptr && *runtimeDirectory != '\0') {
+        return std::string(runtimeDirectory) + "/myfind.sock";
+    }
+    return "/tmp/myfind-" + std::to_string(getuid()) + ".sock";
+}
+
+int runDaemon(const std::string& root, const std::string& socketPath) {
+    sockaddr_un address;
+    if (!fillAddress(socketPath, address)) {
+        std::cerr << "Error: Socket path too long: " << socketPath << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // a socket nobody listens on is left over from a daemon that was killed
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        close(probe);
+        std::cerr << "Error: Another daemon is already listening on " << socketPath << "\n";
+        return EXIT_FAILURE;
+    }
+    close(probe);
+    unlink(socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t previousMask = umask(077); // the answers reveal filenames, keep the socket private
+    int bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(previousMask);
+    if (bound != 0 || listen(listener, 16) != 0) {
+        std::cerr << "Error: Cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+        close(listener);
+        return EXIT_FAILURE;
+    }
+
+    int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        std::cerr << "Error: inotify is not available: " << strerror(errno) << "\n";
+        close(listener);
+        unlink(socketPath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    NameTree tree(root, inotifyFd);
+    tree.rescan();
+    std::cerr << "myfind: indexed " << tree.size() << " entries in " << tree.watched()
+              << " watched directories below " << root << ", listening on " << socketPath << "\n";
+
+    // event buffer aligned for inotify_event
+    alignas(inotify_event) char events[64 * 1024];
+    char buffer[4096];
+    std::vector<Client> clients;
+    std::vector<pollfd> pollFds;
+
+    while (!stopRequested) {
+        // inotify, the listener, then one entry per client in the order of clients
+        pollFds.assign({{inotifyFd, POLLIN, 0}, {listener, POLLIN, 0}});
+        auto now = std::chrono::steady_clock::now();
+        int timeout = -1;
+        for (const auto& client : clients) {
+            pollFds.push_back({client.fd, POLLIN, 0});
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(client.deadline - now).count() + 1;
+            left = std::max<decltype(left)>(left, 0);
+            if (timeout < 0 || left < timeout) {
+                timeout = static_cast<int>(left);
+            }
+        }
+        if (poll(pollFds.data(), pollFds.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error: poll failed: " << strerror(errno) << "\n";
+            break;
+        }
+
+        // apply all pending changes before answering, so answers are never stale
+        if (pollFds[0].revents & POLLIN) {
+            ssize_t bytes;
+            while ((bytes = read(inotifyFd, events, sizeof(events))) > 0) {
+                for (char* next = events; next < events + bytes;) {
+                    const auto* event = reinterpret_cast<const inotify_event*>(next);
+                    tree.handleEvent(*event);
+                    next += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        // read what the clients sent so far, answer those that finished their request and
+        // drop those that take too long
+        now = std::chrono::steady_clock::now();
+        size_t kept = 0;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client& client = clients[i];
+            bool complete = false;
+            bool failed = false;
+            if (pollFds[2 + i].revents != 0) {
+                for (;;) {
+                    ssize_t bytes = recv(client.fd, buffer, sizeof(buffer), 0);
+                    if (bytes > 0) {
+                        client.request.append(buffer, bytes);
+                        failed = client.request.size() > maxRequestSize;
+                        if (failed) {
+                            break;
+                        }
+                        continue;
+                    }
+                    if (bytes < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    complete = bytes == 0;
+                    failed = bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+                    break;
+                }
+            }
+            if (complete) {
+                // the answer is sent in one go, a client that stops reading is given up on
+                // after clientTimeout
+                int flags = fcntl(client.fd, F_GETFL);
+                fcntl(client.fd, F_SETFL, flags & ~O_NONBLOCK);
+                timeval sendTimeout{std::chrono::duration_cast<std::chrono::seconds>(clientTimeout).count(), 0};
+                setsockopt(client.fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+                serveClient(client.fd, client.request, tree, root);
+            }
+            if (complete || failed || now >= client.deadline) {
+                close(client.fd);
+                continue;
+            }
+            if (kept != i) {
+                clients[kept] = std::move(client);
+            }
+            ++kept;
+        }
+        clients.resize(kept);
+
+        if (pollFds[1].revents & POLLIN) {
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (client >= 0) {
+                clients.push_back(Client{client, std::string(), now + clientTimeout});
+            }
+        }
+    }
+
+    for (const auto& client : clients) {
+        close(client.fd);
+    }
+    close(inotifyFd);
+    close(listener);
+    unlink(socketPath.c_str());
+    return 0;
+}
+
+bool queryDaemon(const std::string& socketPath, const std::string& directory, const std::vector<std::string>& names,
+                 bool recursive, bool ignoreCase, const DaemonVisitor& visitor) {
+    // only trust a socket of our own user
+    struct stat status;
+    if (lstat(socketPath.c_str(), &status) != 0 || !S_ISSOCK(status.st_mode) || status.st_uid != getuid()) {
+        return false;
+    }
+    sockaddr_un address;
+    if (!fillAddress(socketPath, address)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // a daemon that is stuck or busy must not hold up the search, walking is the fallback;
+    // the send timeout also bounds connect() while the listen backlog is full
+    timeval timeout{0, std::chrono::duration_cast<std::chrono::microseconds>(queryTimeout).count()};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    std::string request(requestMagic, sizeof(requestMagic));
+    if (recursive) {
+        request += 'R';
+    }
+    if (ignoreCase) {
+        request += 'i';
+    }
+    request += '\0';
+    request += normalizeRoot(directory);
+    request += '\0';
+    for (const auto& name : names) {
+        request += name;
+        request += '\0';
+    }
+    if (!sendAll(fd, request.data(), request.size())) {
+        close(fd);
+        return false;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // the whole answer is read before anything is passed on, so a daemon that times out or
+    // fails halfway leaves the visitor uncalled and the caller can walk instead
+    std::string answer;
+    char buffer[64 * 1024];
+    bool complete = false;
+    for (;;) {
+        ssize_t bytes = recv(fd, buffer, sizeof(buffer), 0);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            complete = bytes == 0;
+            break;
+        }
+        answer.append(buffer, bytes);
+    }
+    close(fd);
+    if (!complete || answer.compare(0, 3, "OK\n") != 0) {
+        return false;
+    }
+
+    // pass on every (name number, path) pair, or none if the answer is malformed
+    std::string_view pairs = std::string_view(answer).substr(3);
+    std::vector<std::pair<size_t, std::string_view>> matches;
+    for (;;) {
+        size_t numberEnd = pairs.find('\0');
+        size_t pathEnd = numberEnd == std::string_view::npos ? numberEnd : pairs.find('\0', numberEnd + 1);
+        if (pathEnd == std::string_view::npos) {
+            break;
+        }
+        size_t nameIndex;
+        auto parsed = std::from_chars(pairs.data(), pairs.data() + numberEnd, nameIndex);
+        if (parsed.ec != std::errc() || parsed.ptr != pairs.data() + numberEnd || nameIndex >= names.size()) {
+            return false;
+        }
+        matches.emplace_back(nameIndex, pairs.substr(numberEnd + 1, pathEnd - numberEnd - 1));
+        pairs.remove_prefix(pathEnd + 1);
+    }
+    if (!pairs.empty()) {
+        return false;
+    }
+    // the whole answer is valid, nothing was reported before
+    for (const auto& match : matches) {
+        visitor(match.first, match.second);
+    }
+    return true;
+}
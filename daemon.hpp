@@ -0,0 +1,33 @@
+#ifndef MYFIND_DAEMON_HPP
+#define MYFIND_DAEMON_HPP
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ the daemon keeps every name below its root in memory, follows changes with one inotify
+ watch per directory and answers filename queries on a Unix socket; a query is
+   "MYFIND1\0" flags "\0" absolute search path "\0" name "\0" name "\0" ...
+ where flags holds 'R' and/or 'i', and the answer is "OK\n" followed by
+   name number "\0" path relative to the search path "\0"
+ for every match, or a line starting with "NO" if the daemon cannot answer the query
+ */
+
+// socket path used when --socket is not given, one per user
+std::string defaultSocketPath();
+
+// index root and serve queries on socketPath until SIGINT/SIGTERM, returns the exit code
+int runDaemon(const std::string& root, const std::string& socketPath);
+
+// called for every match with the position of the name and the path relative to the search path
+using DaemonVisitor = std::function<void(size_t nameIndex, std::string_view relativePath)>;
+
+// ask the daemon listening on socketPath; false if there is none, it cannot answer for
+// directory or does not answer within a few hundred milliseconds, in which case visitor
+// was not called
+bool queryDaemon(const std::string& socketPath, const std::string& directory, const std::vector<std::string>& names,
+                 bool recursive, bool ignoreCase, const DaemonVisitor& visitor);
+
+#endif
@@ -0,0 +1,224 @@
+#include "filter.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace {
+
+// DT_* for a -type letter, DT_UNKNOWN for none
+unsigned char typeLetter(char letter) {
+    switch (letter) {
+        case 'b': return DT_BLK;
+        case 'c': return DT_CHR;
+        case 'd': return DT_DIR;
+        case 'p': return DT_FIFO;
+        case 'f': return DT_REG;
+        case 'l': return DT_LNK;
+        case 's': return DT_SOCK;
+        default: return DT_UNKNOWN;
+    }
+}
+
+// whole decimal or octal number, false if text is anything else
+bool parseNumber(std::string_view text, int base, int64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    std::string digits(text);
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = strtoll(digits.c_str(), &end, base);
+    if (*end != '\0' || errno == ERANGE || parsed < 0 || !(digits[0] >= '0' && digits[0] <= '9')) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// leading '+' or '-' of a numeric argument as '>' or '<', '=' without one
+char takeComparison(std::string_view& text) {
+    if (!text.empty() && (text[0] == '+' || text[0] == '-')) {
+        char comparison = text[0] == '+' ? '>' : '<';
+        text.remove_prefix(1);
+        return comparison;
+    }
+    return '=';
+}
+
+int64_t nanoseconds(const struct statx_timestamp& time) {
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+} // namespace
+
+MetadataFilter::MetadataFilter() : now(time(nullptr)) {}
+
+void MetadataFilter::add(const std::string& name, const std::string& argument) {
+    Predicate predicate;
+    std::string_view text(argument);
+    if (name == "type") {
+        predicate.kind = Kind::Type;
+        // GNU find takes a comma separated list, -type f,d
+        for (size_t start = 0; start <= text.size(); start += 2) {
+            unsigned char type = start < text.size() ? typeLetter(text[start]) : DT_UNKNOWN;
+            if (type == DT_UNKNOWN || (start + 1 < text.size() && text[start + 1] != ',')) {
+                throw std::invalid_argument("Unknown argument to -type: " + argument);
+            }
+            predicate.types |= 1u << type;
+            if (start + 1 == text.size()) {
+                break;
+            }
+        }
+        statxMask |= STATX_TYPE;
+    } else if (name == "perm") {
+        predicate.kind = Kind::Permission;
+        if (!text.empty() && (text[0] == '-' || text[0] == '/')) {
+            predicate.comparison = text[0];
+            text.remove_prefix(1);
+        }
+        // only octal modes, symbolic ones like u+x are not supported
+        if (!parseNumber(text, 8, predicate.value) || predicate.value > 07777) {
+            throw std::invalid_argument("Invalid mode for -perm (octal expected): " + argument);
+        }
+        statxMask |= STATX_MODE;
+    } else if (name == "size") {
+        predicate.kind = Kind::Size;
+        predicate.comparison = takeComparison(text);
+        // find's units, 512 byte blocks without a suffix
+        predicate.unit = 512;
+        if (!text.empty() && !(text.back() >= '0' && text.back() <= '9')) {
+            switch (text.back()) {
+                case 'c': predicate.unit = 1; break;
+                case 'w': predicate.unit = 2; break;
+                case 'b': predicate.unit = 512; break;
+                case 'k': predicate.unit = int64_t(1) << 10; break;
+                case 'M': predicate.unit = int64_t(1) << 20; break;
+                case 'G': predicate.unit = int64_t(1) << 30; break;
+                default: throw std::invalid_argument("Invalid size for -size: " + argument);
+            }
+            text.remove_suffix(1);
+        }
+        if (!parseNumber(text, 10, predicate.value)) {
+            throw std::invalid_argument("Invalid size for -size: " + argument);
+        }
+        statxMask |= STATX_SIZE;
+    } else if (name == "mtime") {
+        predicate.kind = Kind::Modified;
+        predicate.comparison = takeComparison(text);
+        if (!parseNumber(text, 10, predicate.value)) {
+            throw std::invalid_argument("Invalid number of days for -mtime: " + argument);
+        }
+        statxMask |= STATX_MTIME;
+    } else if (name == "newer") {
+        predicate.kind = Kind::NewerThan;
+        predicate.comparison = '>';
+        struct statx status;
+        if (statx(AT_FDCWD, argument.c_str(), 0, STATX_MTIME, &status) != 0) {
+            throw std::invalid_argument("Cannot read -newer file " + argument + ": " + strerror(errno));
+        }
+        predicate.value = nanoseconds(status.stx_mtime);
+        statxMask |= STATX_MTIME;
+    } else {
+        throw std::invalid_argument("Unknown predicate -" + name);
+    }
+
+    // -type first, it is often decided by d_type alone; the others share one statx
+    auto position = std::find_if(predicates.begin(), predicates.end(), [&](const Predicate& other) {
+        return predicate.kind == Kind::Type && other.kind != Kind::Type;
+    });
+    predicates.insert(position, predicate);
+}
+
+bool MetadataFilter::compare(int64_t actual, const Predicate& predicate) {
+    switch (predicate.comparison) {
+        case '<': return actual < predicate.value;
+        case '>': return actual > predicate.value;
+        default: return actual == predicate.value;
+    }
+}
+
+bool MetadataFilter::matches(int directoryFd, std::string_view directory, std::string_view name, unsigned char type,
+                             uint64_t& lookups) const {
+    struct statx status;
+    bool looked = false;
+    std::string path;
+    // the lookup is made once and only if d_type did not decide every -type
+    auto lookUp = [&]() {
+        if (looked) {
+            return true;
+        }
+        if (directoryFd < 0) {
+            path.assign(directory);
+            if (path.empty() || path.back() != '/') {
+                path += '/';
+            }
+        }
+        path.append(name);
+        const char* target = path.c_str();
+        const int base = directoryFd >= 0 ? directoryFd : AT_FDCWD;
+        ++lookups;
+        int result = statx(base, target, followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW, statxMask, &status);
+        if (result != 0 && followSymlinks) {
+            // a dangling symlink is judged by the link itself, as find -L does
+            ++lookups;
+            result = statx(base, target, AT_SYMLINK_NOFOLLOW, statxMask, &status);
+        }
+        looked = result == 0;
+        return looked;
+    };
+
+    for (const Predicate& predicate : predicates) {
+        switch (predicate.kind) {
+            case Kind::Type:
+                if (type == DT_UNKNOWN) {
+                    if (!lookUp()) {
+                        return false;
+                    }
+                    type = IFTODT(status.stx_mode);
+                }
+                if ((predicate.types & (1u << type)) == 0) {
+                    return false;
+                }
+                break;
+            case Kind::Permission: {
+                if (!lookUp()) {
+                    return false;
+                }
+                const int64_t mode = status.stx_mode & 07777;
+                bool holds = predicate.comparison == '-' ? (mode & predicate.value) == predicate.value
+                           : predicate.comparison == '/' ? predicate.value == 0 || (mode & predicate.value) != 0
+                           : mode == predicate.value;
+                if (!holds) {
+                    return false;
+                }
+                break;
+            }
+            case Kind::Size: {
+                if (!lookUp()) {
+                    return false;
+                }
+                const int64_t size = static_cast<int64_t>(status.stx_size);
+                if (!compare((size + predicate.unit - 1) / predicate.unit, predicate)) {
+                    return false;
+                }
+                break;
+            }
+            case Kind::Modified:
+                if (!lookUp() || !compare((static_cast<int64_t>(now) - status.stx_mtime.tv_sec) / 86400, predicate)) {
+                    return false;
+                }
+                break;
+            case Kind::NewerThan:
+                if (!lookUp() || !compare(nanoseconds(status.stx_mtime), predicate)) {
+                    return false;
+                }
+                break;
+        }
+    }
+    return true;
+}
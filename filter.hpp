@@ -0,0 +1,58 @@
+#ifndef MYFIND_FILTER_HPP
+#define MYFIND_FILTER_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// find's -type, -perm, -size, -mtime and -newer, all of which must hold. Predicates are
+// compiled once before the walk and kept cheapest first: -type is answered from d_type
+// where the walker knows it, and only entries the name matched and d_type did not decide
+// are looked up with one statx asking for just the fields the predicates read. That statx is
+// synchronous on the walker thread, also with the uring backend: only the name decides which
+// entries need it, so batching would mean looking up every entry of a chunk or holding back
+// the visitor until its batch completed
+class MetadataFilter {
+public:
+    MetadataFilter();
+
+    // one predicate as given on the command line, e.g. ("size", "+1G");
+    // throws std::invalid_argument if the argument is not valid for it
+    void add(const std::string& predicate, const std::string& argument);
+    // -L: predicates look at what symlinks point to
+    void setFollowSymlinks(bool follow) { followSymlinks = follow; }
+    bool empty() const { return predicates.empty(); }
+
+    // entry name of directory, opened as directoryFd (-1: look up directory + name instead);
+    // type is its DT_* type or DT_UNKNOWN; every statx made is counted in lookups
+    bool matches(int directoryFd, std::string_view directory, std::string_view name, unsigned char type,
+                 uint64_t& lookups) const;
+
+private:
+    enum class Kind {
+        Type,        // types: bit (1 << DT_*) for every accepted type
+        Permission,  // value: mode bits, comparison: '=' exact, '-' all of them, '/' any of them
+        Size,        // value: size in units of unit bytes, rounded up
+        Modified,    // value: days since the last modification, rounded down
+        NewerThan,   // value: modification time of the reference file in nanoseconds
+    };
+
+    struct Predicate {
+        Kind kind;
+        char comparison = '='; // '<', '=' or '>' for numbers
+        int64_t value = 0;
+        int64_t unit = 1;
+        unsigned types = 0;
+    };
+
+    static bool compare(int64_t actual, const Predicate& predicate);
+
+    std::vector<Predicate> predicates; // cheapest first
+    unsigned statxMask = 0;            // fields the predicates read
+    bool followSymlinks = false;
+    time_t now; // -mtime counts days back from when the filter was compiled
+};
+
+#endif
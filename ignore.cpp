@@ -0,0 +1,269 @@
+#include "ignore.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// ignore files of one directory, in increasing precedence
+const char* const ignoreFiles[] = {".gitignore", ".ignore"};
+
+// append the file name in directory (relative to fd if it is not -1) to text
+bool readFile(int fd, const std::string& directory, const char* name, std::string& text) {
+    int file = fd >= 0 ? openat(fd, name, O_RDONLY | O_CLOEXEC)
+                       : open((directory == "/" ? directory + name : directory + "/" + name).c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return false;
+    }
+    char buffer[16 * 1024];
+    for (;;) {
+        ssize_t bytes = read(file, buffer, sizeof(buffer));
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            break;
+        }
+        text.append(buffer, bytes);
+    }
+    close(file);
+    text += '\n';
+    return true;
+}
+
+// gitignore has no {a,b}, braces are literal there but not for GlobPattern
+std::string escapeBraces(std::string_view pattern) {
+    std::string escaped;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+            escaped += pattern[i++];
+        } else if (pattern[i] == '{' || pattern[i] == '}') {
+            escaped += '\\';
+        }
+        escaped += pattern[i];
+    }
+    return escaped;
+}
+
+// match components parts[p...] against segments[s...], "**" takes any number of components
+template <typename Segments>
+bool matchSegments(const Segments& segments, size_t s, const std::vector<std::string_view>& parts, size_t p) {
+    for (; s < segments.size(); ++s, ++p) {
+        if (segments[s].anyDirectories) {
+            // a trailing "**" matches everything inside, but not the directory itself
+            size_t first = s + 1 == segments.size() ? p + 1 : p;
+            for (size_t k = first; k <= parts.size(); ++k) {
+                if (matchSegments(segments, s + 1, parts, k)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (p == parts.size() || !segments[s].glob.matches(parts[p])) {
+            return false;
+        }
+    }
+    return p == parts.size();
+}
+
+} // namespace
+
+std::shared_ptr<const IgnoreFrame> IgnoreFrame::forRoot(const std::string& root) {
+    std::shared_ptr<const IgnoreFrame> frame(new IgnoreFrame(nullptr, ""));
+
+    fs::path path = fs::path(root).lexically_normal();
+    if (!path.has_filename() && path != path.root_path()) {
+        path = path.parent_path(); // "/a/b/" -> "/a/b"
+    }
+    std::error_code error;
+    if (fs::exists(path / ".git", error)) {
+        return frame;
+    }
+
+    // directories between the top of the work tree and root, outermost first
+    std::vector<fs::path> ancestors;
+    for (fs::path directory = path.parent_path(); !directory.empty(); directory = directory.parent_path()) {
+        ancestors.push_back(directory);
+        if (fs::exists(directory / ".git", error)) {
+            for (auto it = ancestors.rbegin(); it != ancestors.rend(); ++it) {
+                frame = load(frame, it->native(), -1);
+            }
+            return frame;
+        }
+        if (directory == directory.root_path()) {
+            break;
+        }
+    }
+    return frame; // not inside a work tree
+}
+
+bool IgnoreFrame::isIgnoreFile(std::string_view name) {
+    for (const char* file : ignoreFiles) {
+        if (name == file) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<const IgnoreFrame> IgnoreFrame::load(const std::shared_ptr<const IgnoreFrame>& parent,
+                                                     const std::string& directory, int fd) {
+    std::string text;
+    for (const char* name : ignoreFiles) {
+        readFile(fd, directory, name, text);
+    }
+    if (text.empty()) {
+        return parent;
+    }
+    std::shared_ptr<IgnoreFrame> frame(new IgnoreFrame(parent, directory));
+    if (!frame->parse(text)) {
+        return parent;
+    }
+    return frame;
+}
+
+bool IgnoreFrame::parse(std::string_view text) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        std::string_view line = text.substr(start, end - start);
+        start = end + 1;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        // trailing spaces do not count unless escaped
+        while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')) {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        Rule rule;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.directoryOnly = true;
+            line.remove_suffix(1);
+        }
+        // "**/name" is the same as "name"
+        while (line.size() > 3 && line.substr(0, 3) == "**/" && line.find('/', 3) == std::string_view::npos) {
+            line.remove_prefix(3);
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        rule.anchored = line.find('/') != std::string_view::npos;
+        int index = static_cast<int>(rules.size());
+        if (rule.anchored) {
+            if (line[0] == '/') {
+                line.remove_prefix(1);
+            }
+            size_t first = 0;
+            while (first <= line.size()) {
+                size_t slash = std::min(line.find('/', first), line.size());
+                std::string_view component = line.substr(first, slash - first);
+                first = slash + 1;
+                if (component.empty()) {
+                    continue;
+                }
+                bool anyDirectories = component == "**";
+                rule.segments.push_back(Segment{anyDirectories, GlobPattern(escapeBraces(component), false)});
+            }
+            patterned.push_back(index);
+        } else if (GlobPattern::isGlob(line)) {
+            rule.name.emplace_back(escapeBraces(line), false);
+            patterned.push_back(index);
+        } else {
+            plainNames[GlobPattern::unescape(line)].push_back(index);
+        }
+        rules.push_back(std::move(rule));
+    }
+    return !rules.empty();
+}
+
+int IgnoreFrame::lastMatch(std::string_view entryDirectory, std::string_view name, bool isDirectory) const {
+    int best = -1;
+    if (!plainNames.empty()) {
+        thread_local std::string key;
+        key.assign(name);
+        auto found = plainNames.find(key);
+        if (found != plainNames.end()) {
+            for (auto it = found->second.rbegin(); it != found->second.rend(); ++it) {
+                if (!rules[*it].directoryOnly || isDirectory) {
+                    best = *it;
+                    break;
+                }
+            }
+        }
+    }
+
+    thread_local std::string path;
+    bool pathBuilt = false;
+    for (auto it = patterned.rbegin(); it != patterned.rend() && *it > best; ++it) {
+        const Rule& rule = rules[*it];
+        if (rule.directoryOnly && !isDirectory) {
+            continue;
+        }
+        if (!rule.anchored) {
+            if (rule.name[0].matches(name)) {
+                return *it;
+            }
+            continue;
+        }
+        if (!pathBuilt) {
+            // entry path relative to this frame's directory
+            std::string_view below = entryDirectory.substr(std::min(directory.size(), entryDirectory.size()));
+            while (!below.empty() && below[0] == '/') {
+                below.remove_prefix(1);
+            }
+            path.assign(below);
+            if (!path.empty() && path.back() != '/') {
+                path += '/';
+            }
+            path.append(name);
+            pathBuilt = true;
+        }
+        if (matchesAnchored(rule, path)) {
+            return *it;
+        }
+    }
+    return best;
+}
+
+bool IgnoreFrame::matchesAnchored(const Rule& rule, std::string_view path) const {
+    thread_local std::vector<std::string_view> parts;
+    parts.clear();
+    size_t first = 0;
+    while (first <= path.size()) {
+        size_t slash = std::min(path.find('/', first), path.size());
+        if (slash > first) {
+            parts.push_back(path.substr(first, slash - first));
+        }
+        first = slash + 1;
+    }
+    return matchSegments(rule.segments, 0, parts, 0);
+}
+
+bool IgnoreFrame::ignored(std::string_view entryDirectory, std::string_view name, bool isDirectory) const {
+    // git never looks inside its own directory
+    if (isDirectory && name == ".git") {
+        return true;
+    }
+    // the innermost frame with a matching rule decides, within a frame the last rule does
+    for (const IgnoreFrame* frame = this; frame != nullptr; frame = frame->parent.get()) {
+        int index = frame->lastMatch(entryDirectory, name, isDirectory);
+        if (index >= 0) {
+            return !frame->rules[index].negated;
+        }
+    }
+    return false;
+}
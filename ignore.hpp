@@ -0,0 +1,68 @@
+#ifndef MYFIND_IGNORE_HPP
+#define MYFIND_IGNORE_HPP
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "match.hpp"
+
+// rules of one directory's .gitignore and .ignore (the latter wins), chained to the frames
+// of the directories above it. Frames are immutable and shared: a directory without ignore
+// files keeps its parent's frame, so every pending directory carries the whole rule stack
+// in one pointer and entering or leaving a directory costs nothing.
+// Supports comments, '!' negation, trailing '/' for directories only, patterns anchored by
+// a '/' and '**'; '*' and '?' never match '/'.
+class IgnoreFrame {
+public:
+    // frames for the enclosing git work tree down to root's parent, so rules above the search
+    // path apply as well; never nullptr, an empty frame if there is nothing to load
+    static std::shared_ptr<const IgnoreFrame> forRoot(const std::string& root);
+
+    // frame for directory (an absolute path) on top of parent, or parent itself if the
+    // directory has no ignore files; they are opened relative to fd if it is not -1
+    static std::shared_ptr<const IgnoreFrame> load(const std::shared_ptr<const IgnoreFrame>& parent,
+                                                   const std::string& directory, int fd);
+
+    // name is one of the files load() reads
+    static bool isIgnoreFile(std::string_view name);
+
+    // entry name of directory (this frame's directory or one below it) is ignored
+    bool ignored(std::string_view directory, std::string_view name, bool isDirectory) const;
+
+private:
+    // one path component of an anchored rule
+    struct Segment {
+        bool anyDirectories; // "**": zero or more components
+        GlobPattern glob;
+    };
+
+    struct Rule {
+        bool negated = false;
+        bool directoryOnly = false;
+        // anchored rules are matched against the path below the frame's directory, the
+        // others against the name alone
+        bool anchored = false;
+        std::vector<Segment> segments; // anchored
+        std::vector<GlobPattern> name; // not anchored and a glob, empty or one pattern
+    };
+
+    IgnoreFrame(std::shared_ptr<const IgnoreFrame> parent, std::string directory)
+        : parent(std::move(parent)), directory(std::move(directory)) {}
+
+    bool parse(std::string_view text);
+    // index of the last rule matching the entry, -1 if none does
+    int lastMatch(std::string_view directory, std::string_view name, bool isDirectory) const;
+    bool matchesAnchored(const Rule& rule, std::string_view path) const;
+
+    std::shared_ptr<const IgnoreFrame> parent;
+    std::string directory;
+    std::vector<Rule> rules;
+    // rules that are plain names, looked up instead of tried one by one: name -> rule indices
+    std::unordered_map<std::string, std::vector<int>> plainNames;
+    std::vector<int> patterned; // indices of all other rules, ascending
+};
+
+#endif
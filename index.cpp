@@ -0,0 +1,630 @@
+#include "index.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char indexMagic[8] = {'M', 'Y', 'F', 'I', 'N', 'D', 'I', 'X'};
+constexpr uint32_t indexVersion = 3;
+constexpr uint64_t entriesPerBlock = 64;
+
+// header field offsets
+constexpr size_t versionField = 8;
+constexpr size_t checksumField = 12;
+constexpr size_t fileSizeField = 16;
+constexpr size_t entryCountField = 24;
+constexpr size_t rootOffsetField = 32;
+constexpr size_t rootSizeField = 40;
+constexpr size_t pathsOffsetField = 48;
+constexpr size_t pathsSizeField = 56;
+constexpr size_t blockTableOffsetField = 64;
+constexpr size_t blockCountField = 72;
+constexpr size_t namesOffsetField = 80;
+constexpr size_t directoriesOffsetField = 88;
+constexpr size_t directoryCountField = 96;
+constexpr size_t namesChecksumField = 104;
+constexpr size_t directoriesChecksumField = 108;
+constexpr size_t headerSize = 112;
+
+constexpr size_t blockInfoSize = 16;       // offset, size, checksum
+constexpr size_t nameSlotSize = 8;         // hash, entry
+constexpr size_t directoryRecordSize = 40; // entry, reserved, dev, inode, mtime, ctime
+
+// entry number of the root in directory records
+constexpr uint32_t rootEntry = UINT32_MAX;
+
+constexpr uint8_t directoryFlag = 1;
+
+void putU32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+void putU64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+uint32_t getU32(const unsigned char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t getU64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool getVarint(const unsigned char*& in, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        unsigned char byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// FNV-1a, continued from a previous checksum when given one
+uint32_t checksum(const unsigned char* data, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+char foldChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// FNV-1a of the ASCII case-folded name, the same for exact and -i queries
+uint32_t nameHash(std::string_view name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(foldChar(c))) * 16777619u;
+    }
+    return hash;
+}
+
+bool equalIgnoringCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (foldChar(a[i]) != foldChar(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view baseName(std::string_view path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+struct IndexEntry {
+    std::string path;
+    bool isDirectory;
+};
+
+// everything found below the root by one walk
+struct TreeScan {
+    std::vector<IndexEntry> entries;
+    // status of every directory that could be opened, by path relative to the root ("" is the root)
+    std::unordered_map<std::string, DirectoryStatus> directories;
+};
+
+DirectoryStatus directoryStatus(const struct stat& status) {
+    return DirectoryStatus{
+        static_cast<uint64_t>(status.st_dev),
+        static_cast<uint64_t>(status.st_ino),
+        static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec,
+        static_cast<int64_t>(status.st_ctim.tv_sec) * 1000000000 + status.st_ctim.tv_nsec,
+    };
+}
+
+void putDirectoryRecord(std::string& out, uint32_t entry, const DirectoryStatus& status) {
+    unsigned char record[directoryRecordSize] = {};
+    putU32(record, entry);
+    putU64(record + 8, status.device);
+    putU64(record + 16, status.inode);
+    putU64(record + 24, static_cast<uint64_t>(status.modified));
+    putU64(record + 32, static_cast<uint64_t>(status.changed));
+    out.append(reinterpret_cast<const char*>(record), directoryRecordSize);
+}
+
+// fsync of a file or directory by name, false with errno set on failure
+bool syncPath(const std::string& path, int flags) {
+    int fd = open(path.c_str(), flags | O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    int error = errno;
+    close(fd);
+    errno = error;
+    return synced;
+}
+
+void writeIndex(const std::string& indexFile, const std::string& root, TreeScan& scan) {
+    std::vector<IndexEntry>& entries = scan.entries;
+    std::sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+        return a.path < b.path;
+    });
+
+    // written next to the old index and renamed over it, so readers never see half a file; the
+    // file is synced before the rename and the directory after it, so a crash leaves either the
+    // old or the new index and never a renamed file whose blocks were not written yet
+    std::string temporaryFile = indexFile + ".tmp";
+    std::ofstream out(temporaryFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("cannot create " + temporaryFile);
+    }
+
+    std::string header(headerSize, '\0');
+    out.write(header.data(), header.size());
+    out.write(root.data(), root.size());
+
+    // front-coded path blocks
+    const uint64_t pathsOffset = headerSize + root.size();
+    std::string blockTable;
+    std::string block;
+    uint64_t pathsSize = 0;
+    for (size_t first = 0; first < entries.size(); first += entriesPerBlock) {
+        block.clear();
+        size_t last = std::min<size_t>(first + entriesPerBlock, entries.size());
+        for (size_t i = first; i < last; ++i) {
+            const std::string& path = entries[i].path;
+            size_t shared = 0;
+            if (i > first) {
+                const std::string& previous = entries[i - 1].path;
+                size_t limit = std::min(previous.size(), path.size());
+                while (shared < limit && previous[shared] == path[shared]) {
+                    ++shared;
+                }
+            }
+            putVarint(block, shared);
+            putVarint(block, path.size() - shared);
+            block += static_cast<char>(entries[i].isDirectory ? directoryFlag : 0);
+            block.append(path, shared, std::string::npos);
+        }
+
+        unsigned char info[blockInfoSize];
+        putU64(info, pathsSize);
+        putU32(info + 8, static_cast<uint32_t>(block.size()));
+        putU32(info + 12, checksum(reinterpret_cast<const unsigned char*>(block.data()), block.size()));
+        blockTable.append(reinterpret_cast<const char*>(info), blockInfoSize);
+
+        out.write(block.data(), block.size());
+        pathsSize += block.size();
+    }
+
+    // 8-byte aligned block table and name table
+    uint64_t blockTableOffset = (pathsOffset + pathsSize + 7) & ~uint64_t(7);
+    out.write("\0\0\0\0\0\0\0", blockTableOffset - (pathsOffset + pathsSize));
+    out.write(blockTable.data(), blockTable.size());
+    const uint64_t namesOffset = blockTableOffset + blockTable.size();
+
+    std::vector<std::pair<uint32_t, uint32_t>> names;
+    names.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        names.emplace_back(nameHash(baseName(entries[i].path)), static_cast<uint32_t>(i));
+    }
+    std::sort(names.begin(), names.end());
+    std::string slots;
+    slots.reserve(names.size() * nameSlotSize);
+    for (const auto& name : names) {
+        unsigned char slot[nameSlotSize];
+        putU32(slot, name.first);
+        putU32(slot + 4, name.second);
+        slots.append(reinterpret_cast<const char*>(slot), nameSlotSize);
+    }
+    out.write(slots.data(), slots.size());
+
+    // directory records for incremental updates, ordered by entry number
+    const uint64_t directoriesOffset = namesOffset + slots.size();
+    std::string directories;
+    auto rootStatus = scan.directories.find("");
+    if (rootStatus != scan.directories.end()) {
+        putDirectoryRecord(directories, rootEntry, rootStatus->second);
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].isDirectory) {
+            continue;
+        }
+        auto status = scan.directories.find(entries[i].path);
+        if (status != scan.directories.end()) {
+            putDirectoryRecord(directories, static_cast<uint32_t>(i), status->second);
+        }
+    }
+    out.write(directories.data(), directories.size());
+
+    auto* fields = reinterpret_cast<unsigned char*>(header.data());
+    memcpy(fields, indexMagic, sizeof(indexMagic));
+    putU32(fields + versionField, indexVersion);
+    putU64(fields + fileSizeField, directoriesOffset + directories.size());
+    putU64(fields + entryCountField, entries.size());
+    putU64(fields + rootOffsetField, headerSize);
+    putU64(fields + rootSizeField, root.size());
+    putU64(fields + pathsOffsetField, pathsOffset);
+    putU64(fields + pathsSizeField, pathsSize);
+    putU64(fields + blockTableOffsetField, blockTableOffset);
+    putU64(fields + blockCountField, blockTable.size() / blockInfoSize);
+    putU64(fields + namesOffsetField, namesOffset);
+    putU64(fields + directoriesOffsetField, directoriesOffset);
+    putU64(fields + directoryCountField, directories.size() / directoryRecordSize);
+    putU32(fields + namesChecksumField, checksum(reinterpret_cast<const unsigned char*>(slots.data()), slots.size()));
+    putU32(fields + directoriesChecksumField,
+           checksum(reinterpret_cast<const unsigned char*>(directories.data()), directories.size()));
+    uint32_t headerChecksum = checksum(fields, headerSize);
+    headerChecksum = checksum(reinterpret_cast<const unsigned char*>(root.data()), root.size(), headerChecksum);
+    headerChecksum = checksum(reinterpret_cast<const unsigned char*>(blockTable.data()), blockTable.size(), headerChecksum);
+    putU32(fields + checksumField, headerChecksum);
+    out.seekp(0);
+    out.write(header.data(), header.size());
+
+    out.close();
+    if (!out) {
+        std::remove(temporaryFile.c_str());
+        throw std::runtime_error("cannot write " + temporaryFile);
+    }
+    if (!syncPath(temporaryFile, 0)) {
+        std::string error = strerror(errno);
+        std::remove(temporaryFile.c_str());
+        throw std::runtime_error("cannot write " + temporaryFile + ": " + error);
+    }
+    if (rename(temporaryFile.c_str(), indexFile.c_str()) != 0) {
+        std::remove(temporaryFile.c_str());
+        throw std::runtime_error("cannot replace " + indexFile + ": " + strerror(errno));
+    }
+    std::string directory = fs::path(indexFile).parent_path().native();
+    if (!syncPath(directory.empty() ? "." : directory, O_DIRECTORY)) {
+        throw std::runtime_error("cannot sync the directory of " + indexFile + ": " + strerror(errno));
+    }
+}
+
+}
+
+std::string normalizeRoot(const std::string& root) {
+    std::string normalized = fs::absolute(root).lexically_normal().native();
+    while (normalized.size() > 1 && normalized.back() == '/') {
+        normalized.pop_back();
+    }
+    return normalized;
+}
+
+namespace {
+
+// walk base recursively; directories whose status matches their entry in cache are
+// not read again, their cached listing is used instead
+TreeScan scanTree(const std::string& base, unsigned threads, Backend backend, const DirectoryCache* cache) {
+    // parent directories are absolute, entries are stored relative to base
+    const size_t prefixSize = base == "/" ? 1 : base.size() + 1;
+    auto relativePath = [&](const std::string& path) {
+        return path.size() > prefixSize ? path.substr(prefixSize) : std::string();
+    };
+
+    threads = threads == 0 ? 1 : threads;
+    std::vector<std::vector<IndexEntry>> collected(threads);
+    std::vector<std::vector<std::pair<std::string, DirectoryStatus>>> statuses(threads);
+    std::mutex errorLock;
+
+    auto collect = [&](unsigned worker, const std::string& parent, const WalkEntry& entry) {
+        std::string_view name = entry.name;
+        std::string path;
+        if (parent.size() > prefixSize) {
+            path.reserve(parent.size() - prefixSize + 1 + name.size());
+            path.append(parent, prefixSize, std::string::npos);
+            path += '/';
+        }
+        path += name;
+        collected[worker].push_back(IndexEntry{std::move(path), entry.isDirectory});
+    };
+    auto reportError = [&](const std::string& parent, const std::string& message) {
+        std::lock_guard<std::mutex> guard(errorLock);
+        std::cerr << "Error accessing " << parent << ": " << message << "\n";
+    };
+    auto remember = [&](unsigned worker, const DirTask& task, const struct stat& status) -> const std::vector<CachedEntry>* {
+        std::string path = relativePath(task.path);
+        DirectoryStatus current = directoryStatus(status);
+        const std::vector<CachedEntry>* listing = nullptr;
+        if (cache != nullptr) {
+            auto cached = cache->find(path);
+            if (cached != cache->end() && cached->second.status == current) {
+                listing = &cached->second.entries;
+            }
+        }
+        statuses[worker].emplace_back(std::move(path), current);
+        return listing;
+    };
+
+    ParallelWalker walker(threads, true, backend, collect, reportError);
+    walker.setDirectoryHook(remember);
+    walker.run(base);
+
+    TreeScan scan;
+    scan.entries = std::move(collected[0]);
+    for (unsigned i = 0; i < threads; ++i) {
+        if (i > 0) {
+            std::move(collected[i].begin(), collected[i].end(), std::back_inserter(scan.entries));
+            collected[i].clear();
+        }
+        for (auto& status : statuses[i]) {
+            scan.directories.insert(std::move(status));
+        }
+    }
+    if (scan.entries.size() > UINT32_MAX) {
+        throw std::runtime_error("too many entries for one index");
+    }
+    return scan;
+}
+
+}
+
+void buildIndex(const std::string& indexFile, const std::string& root, unsigned threads, Backend backend) {
+    const std::string base = normalizeRoot(root);
+    TreeScan scan = scanTree(base, threads, backend, nullptr);
+    writeIndex(indexFile, base, scan);
+}
+
+void updateIndex(const std::string& indexFile, unsigned threads, Backend backend) {
+    std::string base;
+    DirectoryCache cache;
+    {
+        IndexReader previous(indexFile);
+        base = previous.root();
+
+        // rebuild every directory listing from the stored paths
+        std::vector<std::string> paths(previous.size());
+        previous.forEachEntry([&](uint64_t entry, std::string_view path, bool isDirectory) {
+            paths[entry] = path;
+            size_t slash = path.rfind('/');
+            std::string parent(slash == std::string_view::npos ? std::string_view() : path.substr(0, slash));
+            std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+            cache[parent].entries.push_back(CachedEntry{std::string(name), isDirectory});
+        });
+        previous.forEachDirectory([&](uint64_t entry, const DirectoryStatus& status) {
+            cache[entry == rootEntry ? std::string() : paths[entry]].status = status;
+        });
+        // a directory without record (it could not be opened last time) is read again
+        for (auto it = cache.begin(); it != cache.end();) {
+            it = it->second.status.inode == 0 ? cache.erase(it) : std::next(it);
+        }
+    }
+
+    TreeScan scan = scanTree(base, threads, backend, &cache);
+    cache.clear();
+    writeIndex(indexFile, base, scan);
+}
+
+IndexReader::IndexReader(const std::string& indexFile) {
+    fd = open(indexFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + indexFile + ": " + strerror(errno));
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(headerSize)) {
+        close(fd);
+        throw std::runtime_error(indexFile + " is not a myfind index");
+    }
+    dataSize = status.st_size;
+    void* mapping = mmap(nullptr, dataSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("cannot map " + indexFile + ": " + strerror(errno));
+    }
+    data = static_cast<const unsigned char*>(mapping);
+
+    auto fail = [&](const std::string& reason) {
+        munmap(const_cast<unsigned char*>(data), dataSize);
+        close(fd);
+        throw std::runtime_error(indexFile + ": " + reason);
+    };
+
+    if (memcmp(data, indexMagic, sizeof(indexMagic)) != 0) {
+        fail("not a myfind index");
+    }
+    if (getU32(data + versionField) != indexVersion) {
+        fail("unsupported index version " + std::to_string(getU32(data + versionField)) + ", rebuild it");
+    }
+
+    entryCount = getU64(data + entryCountField);
+    blockCount = getU64(data + blockCountField);
+    uint64_t rootOffset = getU64(data + rootOffsetField);
+    uint64_t rootSize = getU64(data + rootSizeField);
+    uint64_t pathsOffset = getU64(data + pathsOffsetField);
+    uint64_t pathsSize = getU64(data + pathsSizeField);
+    uint64_t blockTableOffset = getU64(data + blockTableOffsetField);
+    uint64_t namesOffset = getU64(data + namesOffsetField);
+    uint64_t directoriesOffset = getU64(data + directoriesOffsetField);
+    directoryCount = getU64(data + directoryCountField);
+
+    // every section has to lie inside the file before anything is read from it
+    auto inside = [&](uint64_t offset, uint64_t size) {
+        return offset <= dataSize && size <= dataSize - offset;
+    };
+    if (getU64(data + fileSizeField) != dataSize
+        || blockCount != (entryCount + entriesPerBlock - 1) / entriesPerBlock
+        || entryCount > UINT32_MAX
+        || !inside(rootOffset, rootSize) || !inside(pathsOffset, pathsSize)
+        || !inside(blockTableOffset, blockCount * blockInfoSize)
+        || !inside(namesOffset, entryCount * nameSlotSize)
+        || directoryCount > entryCount + 1
+        || !inside(directoriesOffset, directoryCount * directoryRecordSize)) {
+        fail("index is truncated or corrupt");
+    }
+
+    unsigned char header[headerSize];
+    memcpy(header, data, headerSize);
+    putU32(header + checksumField, 0);
+    uint32_t expected = checksum(header, headerSize);
+    expected = checksum(data + rootOffset, rootSize, expected);
+    expected = checksum(data + blockTableOffset, blockCount * blockInfoSize, expected);
+    if (expected != getU32(data + checksumField)) {
+        fail("index checksum mismatch");
+    }
+    // name table and directory records are small next to the paths and checked in full
+    // here, path blocks only when first decoded
+    if (checksum(data + namesOffset, entryCount * nameSlotSize) != getU32(data + namesChecksumField)) {
+        fail("index name table checksum mismatch");
+    }
+    if (checksum(data + directoriesOffset, directoryCount * directoryRecordSize) != getU32(data + directoriesChecksumField)) {
+        fail("index directory records checksum mismatch");
+    }
+
+    rootPath.assign(reinterpret_cast<const char*>(data + rootOffset), rootSize);
+    blockTable = data + blockTableOffset;
+    nameTable = data + namesOffset;
+    directoryRecords = data + directoriesOffset;
+    pathsData = data + pathsOffset;
+    pathsDataSize = pathsSize;
+    verifiedBlocks.assign(blockCount, false);
+}
+
+IndexReader::~IndexReader() {
+    munmap(const_cast<unsigned char*>(data), dataSize);
+    close(fd);
+}
+
+const unsigned char* IndexReader::blockData(uint64_t number, size_t& size) const {
+    const unsigned char* info = blockTable + number * blockInfoSize;
+    uint64_t offset = getU64(info);
+    size = getU32(info + 8);
+    if (offset > pathsDataSize || size > pathsDataSize - offset) {
+        throw std::runtime_error("index block " + std::to_string(number) + " is out of bounds");
+    }
+
+    const unsigned char* block = pathsData + offset;
+    if (!verifiedBlocks[number]) {
+        if (checksum(block, size) != getU32(info + 12)) {
+            throw std::runtime_error("index block " + std::to_string(number) + " checksum mismatch");
+        }
+        verifiedBlocks[number] = true;
+    }
+    return block;
+}
+
+void IndexReader::decodeNext(const unsigned char*& in, const unsigned char* end, std::string& path, bool& isDirectory) const {
+    uint64_t shared;
+    uint64_t suffix;
+    if (!getVarint(in, end, shared) || !getVarint(in, end, suffix)
+        || shared > path.size() || in >= end || suffix > static_cast<uint64_t>(end - in - 1)) {
+        throw std::runtime_error("index path block is corrupt");
+    }
+    isDirectory = (*in++ & directoryFlag) != 0;
+    path.resize(shared);
+    path.append(reinterpret_cast<const char*>(in), suffix);
+    in += suffix;
+}
+
+std::string_view IndexReader::decodeEntry(uint64_t entry, std::string& path, bool& isDirectory) const {
+    uint64_t number = entry / entriesPerBlock;
+    size_t size;
+    const unsigned char* in = blockData(number, size);
+    const unsigned char* end = in + size;
+
+    path.clear();
+    for (uint64_t i = number * entriesPerBlock; i <= entry; ++i) {
+        decodeNext(in, end, path, isDirectory);
+    }
+    return path;
+}
+
+void IndexReader::findName(std::string_view name, bool ignoreCase,
+                           const std::function<void(std::string_view relativePath, bool isDirectory)>& visitor) const {
+    const uint32_t hash = nameHash(name);
+
+    // first slot with this hash
+    uint64_t low = 0;
+    uint64_t high = entryCount;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (getU32(nameTable + middle * nameSlotSize) < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    std::string path;
+    for (uint64_t slot = low; slot < entryCount && getU32(nameTable + slot * nameSlotSize) == hash; ++slot) {
+        uint64_t entry = getU32(nameTable + slot * nameSlotSize + 4);
+        if (entry >= entryCount) {
+            throw std::runtime_error("index name table is corrupt");
+        }
+        bool isDirectory;
+        std::string_view candidate = baseName(decodeEntry(entry, path, isDirectory));
+        if (ignoreCase ? equalIgnoringCase(candidate, name) : candidate == name) {
+            visitor(path, isDirectory);
+        }
+    }
+}
+
+void IndexReader::forEachEntry(const std::function<void(uint64_t entry, std::string_view relativePath, bool isDirectory)>& visitor) const {
+    std::string path;
+    for (uint64_t number = 0; number < blockCount; ++number) {
+        size_t size;
+        const unsigned char* in = blockData(number, size);
+        const unsigned char* end = in + size;
+        uint64_t first = number * entriesPerBlock;
+        uint64_t last = std::min(first + entriesPerBlock, entryCount);
+
+        path.clear();
+        for (uint64_t entry = first; entry < last; ++entry) {
+            bool isDirectory;
+            decodeNext(in, end, path, isDirectory);
+            visitor(entry, path, isDirectory);
+        }
+    }
+}
+
+void IndexReader::forEachDirectory(const std::function<void(uint64_t entry, const DirectoryStatus& status)>& visitor) const {
+    for (uint64_t i = 0; i < directoryCount; ++i) {
+        const unsigned char* record = directoryRecords + i * directoryRecordSize;
+        uint64_t entry = getU32(record);
+        if (entry != rootEntry && entry >= entryCount) {
+            throw std::runtime_error("index directory record " + std::to_string(i) + " is corrupt");
+        }
+        DirectoryStatus status{
+            getU64(record + 8),
+            getU64(record + 16),
+            static_cast<int64_t>(getU64(record + 24)),
+            static_cast<int64_t>(getU64(record + 32)),
+        };
+        visitor(entry, status);
+    }
+}
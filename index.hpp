@@ -0,0 +1,106 @@
+#ifndef MYFIND_INDEX_HPP
+#define MYFIND_INDEX_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "walk.hpp"
+
+/*
+ filename index file, all integers little-endian:
+ - header: magic "MYFINDIX", format version, checksum over header, root and block table, section
+   offsets, checksums of the name table and of the directory records
+ - root: absolute path of the indexed directory, entries are stored relative to it
+ - paths: entries sorted by path and front-coded in blocks of 64, every block starts with a
+   full path so it can be decoded on its own; an entry is varint(shared prefix length),
+   varint(suffix length), flags byte, suffix
+ - block table: offset, size and checksum of every block
+ - name table: (hash of case-folded filename, entry number) sorted by hash, so a filename
+   query is a binary search plus decoding the few blocks the candidates are in
+ - directory records: device, inode, mtime and ctime of the root and every directory entry,
+   --update-index only reads directories whose record no longer matches
+ errors are reported as std::runtime_error
+ */
+
+// what tells whether a directory changed since it was indexed; creating, deleting or
+// renaming an entry updates the directory's mtime and ctime
+struct DirectoryStatus {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t modified = 0; // mtime in nanoseconds
+    int64_t changed = 0;  // ctime in nanoseconds
+
+    bool operator==(const DirectoryStatus& other) const {
+        return device == other.device && inode == other.inode
+            && modified == other.modified && changed == other.changed;
+    }
+};
+
+// listing of a directory as stored in an index, with the status it had back then
+struct CachedDirectory {
+    DirectoryStatus status;
+    std::vector<CachedEntry> entries;
+};
+
+// cached listings by path relative to the index root ("" is the root)
+using DirectoryCache = std::unordered_map<std::string, CachedDirectory>;
+
+// absolute path without "." / ".." components and without trailing slash
+std::string normalizeRoot(const std::string& root);
+
+// walk root recursively and write an index of everything below it to indexFile
+void buildIndex(const std::string& indexFile, const std::string& root, unsigned threads, Backend backend);
+
+// rewrite indexFile for the current state of its root, reading only directories that changed
+void updateIndex(const std::string& indexFile, unsigned threads, Backend backend);
+
+// read-only view of an index file mapped into memory
+class IndexReader {
+public:
+    explicit IndexReader(const std::string& indexFile);
+    ~IndexReader();
+    IndexReader(const IndexReader&) = delete;
+    IndexReader& operator=(const IndexReader&) = delete;
+
+    // absolute path the index was built for, without trailing slash
+    const std::string& root() const { return rootPath; }
+    uint64_t size() const { return entryCount; }
+
+    // call visitor with the path (relative to root) of every entry whose filename
+    // equals name, ignoring ASCII case if ignoreCase is set
+    void findName(std::string_view name, bool ignoreCase,
+                  const std::function<void(std::string_view relativePath, bool isDirectory)>& visitor) const;
+
+    // call visitor for every entry in path order
+    void forEachEntry(const std::function<void(uint64_t entry, std::string_view relativePath, bool isDirectory)>& visitor) const;
+    // call visitor for every directory record, the root has entry number UINT32_MAX
+    void forEachDirectory(const std::function<void(uint64_t entry, const DirectoryStatus& status)>& visitor) const;
+
+private:
+    // bounds-checked start of a path block, checks the block checksum the first time
+    const unsigned char* blockData(uint64_t number, size_t& size) const;
+    // decode the entry at in, which shares a prefix with the previous one in path
+    void decodeNext(const unsigned char*& in, const unsigned char* end, std::string& path, bool& isDirectory) const;
+    // decode entry number from the start of its block
+    std::string_view decodeEntry(uint64_t entry, std::string& path, bool& isDirectory) const;
+
+    int fd = -1;
+    const unsigned char* data = nullptr;
+    size_t dataSize = 0;
+    std::string rootPath;
+    uint64_t entryCount = 0;
+    uint64_t blockCount = 0;
+    const unsigned char* blockTable = nullptr;
+    const unsigned char* nameTable = nullptr;
+    const unsigned char* directoryRecords = nullptr;
+    uint64_t directoryCount = 0;
+    const unsigned char* pathsData = nullptr;
+    uint64_t pathsDataSize = 0;
+    mutable std::vector<bool> verifiedBlocks;
+};
+
+#endif
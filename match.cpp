@@ -0,0 +1,608 @@
+#include "match.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MYFIND_X86_KERNELS 1
+#endif
+
+namespace {
+
+// limit for {a,b} expansion, nested braces multiply quickly
+constexpr size_t maximumAlternatives = 1024;
+
+char foldChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+char otherCase(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return static_cast<char>(c - 'A' + 'a');
+    }
+    if (c >= 'a' && c <= 'z') {
+        return static_cast<char>(c - 'a' + 'A');
+    }
+    return c;
+}
+
+void addCharacter(std::array<uint64_t, 4>& set, unsigned char c) {
+    set[c >> 6] |= uint64_t(1) << (c & 63);
+}
+
+bool hasCharacter(const std::array<uint64_t, 4>& set, unsigned char c) {
+    return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+// end of the [...] class starting at start, or npos if it is not closed
+size_t classEnd(std::string_view pattern, size_t start) {
+    size_t i = start + 1;
+    if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^')) {
+        ++i;
+    }
+    if (i < pattern.size() && pattern[i] == ']') {
+        ++i; // a leading ']' is part of the class
+    }
+    for (; i < pattern.size(); ++i) {
+        if (pattern[i] == '\\') {
+            ++i;
+        } else if (pattern[i] == ']') {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// expand the first {a,b,...} group of pattern and recurse into the results
+void expandBraces(const std::string& pattern, std::vector<std::string>& out) {
+    size_t open = std::string::npos;
+    std::vector<size_t> commas;
+    size_t close = std::string::npos;
+    int depth = 0;
+
+    for (size_t i = 0; i < pattern.size() && close == std::string::npos; ++i) {
+        char c = pattern[i];
+        if (c == '\\') {
+            ++i;
+        } else if (c == '[') {
+            size_t end = classEnd(pattern, i);
+            if (end != std::string::npos) {
+                i = end;
+            }
+        } else if (c == '{') {
+            if (depth++ == 0) {
+                open = i;
+                commas.clear();
+            }
+        } else if (c == ',' && depth == 1) {
+            commas.push_back(i);
+        } else if (c == '}' && depth > 0) {
+            if (--depth == 0) {
+                if (commas.empty()) {
+                    open = std::string::npos; // "{a}" is not a group, like in the shell
+                } else {
+                    close = i;
+                }
+            }
+        }
+    }
+
+    if (close == std::string::npos || out.size() >= maximumAlternatives) {
+        out.push_back(pattern);
+        return;
+    }
+
+    std::string head = pattern.substr(0, open);
+    std::string tail = pattern.substr(close + 1);
+    size_t start = open + 1;
+    commas.push_back(close);
+    for (size_t comma : commas) {
+        expandBraces(head + pattern.substr(start, comma - start) + tail, out);
+        start = comma + 1;
+    }
+}
+
+bool equalsFoldedScalar(const char* name, const char* folded, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (foldChar(name[i]) != folded[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef MYFIND_X86_KERNELS
+
+// fold the 'A'..'Z' bytes of 16 bytes to lowercase and compare them with folded ones
+__attribute__((target("sse2")))
+inline bool equalsFolded16(__m128i name, __m128i folded) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(name, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(name, _mm_set1_epi8('Z' + 1)));
+    name = _mm_or_si128(name, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(name, folded)) == 0xffff;
+}
+
+__attribute__((target("sse2")))
+bool equalsFoldedSse2(const char* name, const char* folded, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        if (!equalsFolded16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(name + i)),
+                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(folded + i)))) {
+            return false;
+        }
+    }
+    if (i == size) {
+        return true;
+    }
+    // the rest is copied into zero-padded blocks, reading past the end could fault
+    alignas(16) char nameTail[16] = {};
+    alignas(16) char foldedTail[16] = {};
+    memcpy(nameTail, name + i, size - i);
+    memcpy(foldedTail, folded + i, size - i);
+    return equalsFolded16(_mm_load_si128(reinterpret_cast<const __m128i*>(nameTail)),
+                          _mm_load_si128(reinterpret_cast<const __m128i*>(foldedTail)));
+}
+
+__attribute__((target("avx2")))
+bool equalsFoldedAvx2(const char* name, const char* folded, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(name + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('A' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), block));
+        block = _mm256_or_si256(block, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+        __m256i expected = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(folded + i));
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, expected))) != 0xffffffffu) {
+            return false;
+        }
+    }
+    return equalsFoldedSse2(name + i, folded + i, size - i);
+}
+
+#endif
+
+using EqualsFoldedKernel = bool (*)(const char* name, const char* folded, size_t size);
+
+EqualsFoldedKernel pickEqualsFolded() {
+#ifdef MYFIND_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return equalsFoldedAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return equalsFoldedSse2;
+    }
+#endif
+    return equalsFoldedScalar;
+}
+
+const EqualsFoldedKernel equalsFoldedKernel = pickEqualsFolded();
+
+}
+
+bool equalsFolded(std::string_view name, std::string_view folded) {
+    return equalsFoldedKernel(name.data(), folded.data(), name.size());
+}
+
+std::string foldCase(std::string_view name) {
+    std::string folded(name);
+    for (char& c : folded) {
+        c = foldChar(c);
+    }
+    return folded;
+}
+
+GlobPattern::GlobPattern(std::string_view pattern, bool ignoreCase) : ignoreCase(ignoreCase) {
+    std::vector<std::string> expanded;
+    expandBraces(std::string(pattern), expanded);
+    for (const auto& alternative : expanded) {
+        compile(alternative);
+    }
+}
+
+bool GlobPattern::isGlob(std::string_view pattern) {
+    bool braceOpen = false;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\') {
+            ++i;
+        } else if (c == '*' || c == '?' || (c == '[' && classEnd(pattern, i) != std::string_view::npos)) {
+            return true;
+        } else if (c == '{') {
+            braceOpen = true;
+        } else if (c == '}' && braceOpen) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string GlobPattern::unescape(std::string_view pattern) {
+    std::string plain;
+    plain.reserve(pattern.size());
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+            ++i;
+        }
+        plain += pattern[i];
+    }
+    return plain;
+}
+
+void GlobPattern::compile(std::string_view pattern) {
+    std::vector<Token> tokens;
+    std::string literals; // byte of every Literal token, by token position
+    auto literal = [&](char c) {
+        Token token{Token::Literal, {}};
+        addCharacter(token.characters, c);
+        if (ignoreCase) {
+            addCharacter(token.characters, otherCase(c));
+        }
+        tokens.push_back(token);
+        literals.resize(tokens.size());
+        literals.back() = c;
+    };
+
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            literal(pattern[++i]);
+        } else if (c == '*') {
+            if (tokens.empty() || tokens.back().kind != Token::Star) {
+                tokens.push_back(Token{Token::Star, {}});
+            }
+        } else if (c == '?') {
+            tokens.push_back(Token{Token::Any, {}});
+        } else if (c == '[' && classEnd(pattern, i) != std::string_view::npos) {
+            size_t end = classEnd(pattern, i);
+            Token token{Token::Class, {}};
+            size_t j = i + 1;
+            bool negated = pattern[j] == '!' || pattern[j] == '^';
+            if (negated) {
+                ++j;
+            }
+            for (bool first = true; j < end; first = false) {
+                if (pattern[j] == ']' && !first) {
+                    break;
+                }
+                unsigned char low = pattern[j] == '\\' ? pattern[++j] : pattern[j];
+                ++j;
+                unsigned char high = low;
+                if (j + 1 < end && pattern[j] == '-') {
+                    high = pattern[j + 1] == '\\' && j + 2 < end ? pattern[j + 2] : pattern[j + 1];
+                    j += pattern[j + 1] == '\\' ? 3 : 2;
+                }
+                for (unsigned c = low; c <= high; ++c) {
+                    addCharacter(token.characters, static_cast<unsigned char>(c));
+                    if (ignoreCase) {
+                        addCharacter(token.characters, otherCase(static_cast<char>(c)));
+                    }
+                }
+            }
+            if (negated) {
+                for (auto& word : token.characters) {
+                    word = ~word;
+                }
+            }
+            tokens.push_back(token);
+            i = end;
+        } else {
+            literal(c);
+        }
+    }
+    literals.resize(tokens.size());
+
+    Alternative alternative;
+    size_t first = 0;
+    while (first < tokens.size() && tokens[first].kind == Token::Literal) {
+        alternative.prefix += literals[first++];
+    }
+    size_t last = tokens.size();
+    while (last > first && tokens[last - 1].kind == Token::Literal) {
+        --last;
+    }
+    alternative.suffix = literals.substr(last);
+    alternative.middle.assign(tokens.begin() + first, tokens.begin() + last);
+
+    alternative.minimumSize = alternative.prefix.size() + alternative.suffix.size();
+    for (const auto& token : alternative.middle) {
+        if (token.kind == Token::Star) {
+            alternative.hasStar = true;
+        } else {
+            ++alternative.minimumSize;
+        }
+    }
+    alternative.anyMiddle = alternative.middle.size() == 1 && alternative.middle[0].kind == Token::Star;
+
+    // bit-parallel NFA: bit j is set while the first j middle tokens have been matched
+    if (alternative.middle.size() < 64 && !alternative.anyMiddle) {
+        alternative.accept.assign(256, 0);
+        for (size_t j = 0; j < alternative.middle.size(); ++j) {
+            const Token& token = alternative.middle[j];
+            if (token.kind == Token::Star) {
+                alternative.starMask |= uint64_t(1) << j;
+                continue;
+            }
+            for (unsigned c = 0; c < 256; ++c) {
+                if (token.kind == Token::Any || hasCharacter(token.characters, static_cast<unsigned char>(c))) {
+                    alternative.accept[c] |= uint64_t(1) << j;
+                }
+            }
+        }
+        alternative.finalBit = uint64_t(1) << alternative.middle.size();
+    }
+
+    alternatives.push_back(std::move(alternative));
+}
+
+bool GlobPattern::equal(std::string_view a, std::string_view b) const {
+    if (!ignoreCase) {
+        return a == b;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (foldChar(a[i]) != foldChar(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GlobPattern::matchesMiddle(const Alternative& alternative, std::string_view middle) const {
+    const std::vector<Token>& tokens = alternative.middle;
+
+    if (!alternative.accept.empty()) {
+        uint64_t state = 1;
+        state |= (state & alternative.starMask) << 1; // a star may match nothing
+        for (unsigned char c : middle) {
+            // consume c with a fixed-width token, or let a star swallow it
+            state = ((state & alternative.accept[c]) << 1) | (state & alternative.starMask);
+            state |= (state & alternative.starMask) << 1;
+            if (state == 0) {
+                return false;
+            }
+        }
+        return (state & alternative.finalBit) != 0;
+    }
+
+    // very long patterns: greedy matching, backtracking to the last star
+    auto accepts = [](const Token& token, unsigned char c) {
+        return token.kind == Token::Any || hasCharacter(token.characters, c);
+    };
+    size_t t = 0;
+    size_t i = 0;
+    size_t starToken = std::string_view::npos;
+    size_t starPosition = 0;
+    while (i < middle.size()) {
+        if (t < tokens.size() && tokens[t].kind == Token::Star) {
+            starToken = t++;
+            starPosition = i;
+        } else if (t < tokens.size() && accepts(tokens[t], middle[i])) {
+            ++t;
+            ++i;
+        } else if (starToken != std::string_view::npos) {
+            t = starToken + 1;
+            i = ++starPosition;
+        } else {
+            return false;
+        }
+    }
+    while (t < tokens.size() && tokens[t].kind == Token::Star) {
+        ++t;
+    }
+    return t == tokens.size();
+}
+
+bool GlobPattern::matches(std::string_view name) const {
+    for (const auto& alternative : alternatives) {
+        if (name.size() < alternative.minimumSize || (!alternative.hasStar && name.size() != alternative.minimumSize)) {
+            continue;
+        }
+        if (!equal(alternative.prefix, name.substr(0, alternative.prefix.size()))
+            || !equal(alternative.suffix, name.substr(name.size() - alternative.suffix.size()))) {
+            continue;
+        }
+        std::string_view middle = name.substr(alternative.prefix.size(),
+                                              name.size() - alternative.prefix.size() - alternative.suffix.size());
+        if (alternative.anyMiddle || (alternative.middle.empty() ? middle.empty() : matchesMiddle(alternative, middle))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SubstringMatcher::SubstringMatcher(const std::vector<std::string>& patterns, bool ignoreCase) {
+    for (const auto& pattern : patterns) {
+        for (char c : pattern) {
+            unsigned char byte = ignoreCase ? foldChar(c) : c;
+            if (byteClass[byte] == 0) {
+                byteClass[byte] = classCount++;
+            }
+        }
+    }
+    if (ignoreCase) {
+        for (unsigned c = 'A'; c <= 'Z'; ++c) {
+            byteClass[c] = byteClass[c - 'A' + 'a'];
+        }
+    }
+
+    // trie of all patterns, 0 in transitions means "no child" until the failure links are in
+    transitions.assign(classCount, 0);
+    std::vector<std::vector<uint32_t>> ending(1);
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        uint32_t state = 0;
+        for (char c : patterns[i]) {
+            uint32_t& next = transitions[state * classCount + byteClass[static_cast<unsigned char>(c)]];
+            if (next == 0) {
+                next = static_cast<uint32_t>(ending.size());
+                ending.emplace_back();
+                transitions.resize(transitions.size() + classCount, 0);
+            }
+            state = transitions[state * classCount + byteClass[static_cast<unsigned char>(c)]];
+        }
+        ending[state].push_back(static_cast<uint32_t>(i));
+    }
+
+    // breadth-first: complete the transition table with the failure links and
+    // collect the outputs of every state's suffix states
+    const size_t stateCount = ending.size();
+    std::vector<uint32_t> failure(stateCount, 0);
+    std::vector<std::vector<uint32_t>> matches(stateCount);
+    matches[0] = ending[0];
+    std::deque<uint32_t> queue;
+    for (uint32_t c = 0; c < classCount; ++c) {
+        if (uint32_t child = transitions[c]) {
+            queue.push_back(child);
+        }
+    }
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        matches[state] = ending[state];
+        const std::vector<uint32_t>& inherited = matches[failure[state]];
+        matches[state].insert(matches[state].end(), inherited.begin(), inherited.end());
+
+        for (uint32_t c = 0; c < classCount; ++c) {
+            uint32_t& next = transitions[state * classCount + c];
+            uint32_t fallback = transitions[failure[state] * classCount + c];
+            if (next != 0) {
+                failure[next] = fallback;
+                queue.push_back(next);
+            } else {
+                next = fallback;
+            }
+        }
+    }
+
+    outputBegin.reserve(stateCount + 1);
+    for (const auto& stateMatches : matches) {
+        outputBegin.push_back(static_cast<uint32_t>(outputs.size()));
+        outputs.insert(outputs.end(), stateMatches.begin(), stateMatches.end());
+    }
+    outputBegin.push_back(static_cast<uint32_t>(outputs.size()));
+}
+
+void SubstringMatcher::find(std::string_view name, std::vector<uint32_t>& matched) const {
+    matched.clear();
+    // the empty pattern is contained in everything
+    matched.insert(matched.end(), outputs.begin() + outputBegin[0], outputs.begin() + outputBegin[1]);
+
+    uint32_t state = 0;
+    for (unsigned char c : name) {
+        state = transitions[state * classCount + byteClass[c]];
+        uint32_t begin = outputBegin[state];
+        uint32_t end = outputBegin[state + 1];
+        if (begin != end) {
+            matched.insert(matched.end(), outputs.begin() + begin, outputs.begin() + end);
+        }
+    }
+    if (matched.size() > 1) {
+        std::sort(matched.begin(), matched.end());
+        matched.erase(std::unique(matched.begin(), matched.end()), matched.end());
+    }
+}
+
+NameMatcher::NameMatcher(const std::vector<std::string>& patterns, bool ignoreCase, MatchMode mode)
+    : ignoreCase(ignoreCase), patternList(patterns) {
+    if (mode == MatchMode::Contains) {
+        substrings = std::make_unique<SubstringMatcher>(patternList, ignoreCase);
+        return;
+    }
+    if (mode == MatchMode::Regex) {
+        for (const auto& pattern : patternList) {
+            regexes.push_back(std::make_unique<RegexPattern>(pattern, ignoreCase));
+        }
+        return;
+    }
+    for (size_t i = 0; i < patternList.size(); ++i) {
+        if (GlobPattern::isGlob(patternList[i])) {
+            globs.emplace_back(GlobPattern(patternList[i], ignoreCase), i);
+        } else {
+            std::string plain = GlobPattern::unescape(patternList[i]);
+            exact[ignoreCase ? foldCase(plain) : plain].push_back(i);
+            size_t size = std::min<size_t>(plain.size(), 255);
+            lengths[size >> 6] |= uint64_t(1) << (size & 63);
+            hasPlainNames = true;
+        }
+    }
+    if (exact.size() <= maximumFewNames) {
+        for (auto& name : exact) {
+            fewNames.push_back(PlainName{name.first, std::move(name.second)});
+        }
+        exact.clear();
+    }
+}
+
+void NameMatcher::measureTime(bool enabled) {
+    for (auto& regex : regexes) {
+        regex->measureTime(enabled);
+    }
+}
+
+const std::vector<size_t>* NameMatcher::findExact(std::string_view name) const {
+    // most entries fail here without being folded, hashed or compared
+    if (!hasLength(name.size())) {
+        return nullptr;
+    }
+
+    if (!fewNames.empty()) {
+        for (const auto& plain : fewNames) {
+            if (plain.key.size() != name.size()) {
+                continue;
+            }
+            if (ignoreCase ? equalsFolded(name, plain.key) : memcmp(name.data(), plain.key.data(), name.size()) == 0) {
+                return &plain.indices;
+            }
+        }
+        return nullptr;
+    }
+
+    // reused per thread, so the lookup does not allocate for every entry
+    thread_local std::string key;
+    key.assign(name.data(), name.size());
+    if (ignoreCase) {
+        for (char& c : key) {
+            c = foldChar(c);
+        }
+    }
+    auto it = exact.find(key);
+    return it == exact.end() ? nullptr : &it->second;
+}
+
+std::vector<std::string> PruneRules::namePatterns(const std::vector<std::string>& patterns) {
+    std::vector<std::string> result;
+    for (const auto& pattern : patterns) {
+        if (pattern.find('/') == std::string::npos) {
+            result.push_back(pattern);
+        }
+    }
+    return result;
+}
+
+PruneRules::PruneRules(const std::vector<std::string>& patterns, bool ignoreCase)
+    : names(namePatterns(patterns), ignoreCase) {
+    for (const auto& pattern : patterns) {
+        if (pattern.find('/') == std::string::npos) {
+            continue;
+        }
+        // "/proc/" names the same directory as "/proc"
+        std::string_view path = pattern;
+        while (path.size() > 1 && path.back() == '/') {
+            path.remove_suffix(1);
+        }
+        paths.emplace_back(path, ignoreCase);
+    }
+}
+
+bool PruneRules::matches(std::string_view path, std::string_view name) const {
+    if (names.forEachMatch(name, [](size_t) {})) {
+        return true;
+    }
+    for (const auto& glob : paths) {
+        if (glob.matches(path)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,182 @@
+#ifndef MYFIND_MATCH_HPP
+#define MYFIND_MATCH_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "regex.hpp"
+
+// lowercase ASCII letters, same folding strcasecmp does in the C locale
+std::string foldCase(std::string_view name);
+
+// name equals folded (already lowercase) ignoring ASCII case; both have to be the same
+// size. Uses AVX2 or SSE2 when the CPU has them, picked once at startup
+bool equalsFolded(std::string_view name, std::string_view folded);
+
+// shell glob (*, ?, [a-z], [!a-z], {a,b}, \ escapes) compiled once before the walk:
+// braces are expanded into alternatives, each alternative keeps its literal prefix and
+// suffix for a cheap first check and runs the rest through a bit-parallel NFA
+class GlobPattern {
+public:
+    GlobPattern(std::string_view pattern, bool ignoreCase);
+
+    // true if pattern uses any wildcard, otherwise it is better matched as a plain string
+    static bool isGlob(std::string_view pattern);
+    // pattern with escapes removed, for patterns that are not globs
+    static std::string unescape(std::string_view pattern);
+
+    bool matches(std::string_view name) const;
+
+private:
+    struct Token {
+        enum Kind { Literal, Any, Class, Star } kind;
+        std::array<uint64_t, 4> characters; // Literal and Class: accepted bytes
+    };
+
+    struct Alternative {
+        std::string prefix;
+        std::string suffix;
+        std::vector<Token> middle; // tokens between prefix and suffix
+        size_t minimumSize = 0;    // of the whole name
+        bool hasStar = false;
+        bool anyMiddle = false;    // middle is a single '*'
+        // NFA: accept[c] has bit j set if middle token j consumes byte c
+        std::vector<uint64_t> accept;
+        uint64_t starMask = 0;
+        uint64_t finalBit = 0;
+    };
+
+    void compile(std::string_view pattern);
+    bool matchesMiddle(const Alternative& alternative, std::string_view middle) const;
+    bool equal(std::string_view a, std::string_view b) const;
+
+    bool ignoreCase;
+    std::vector<Alternative> alternatives;
+};
+
+// Aho-Corasick automaton over all substrings, so every name is scanned once no matter how
+// many patterns there are; bytes are mapped to classes first (with -i both cases share a
+// class), which keeps the full transition table small enough to stay in cache
+class SubstringMatcher {
+public:
+    SubstringMatcher(const std::vector<std::string>& patterns, bool ignoreCase);
+
+    // replace matched with the indices of all patterns contained in name, each once
+    void find(std::string_view name, std::vector<uint32_t>& matched) const;
+
+private:
+    std::array<uint32_t, 256> byteClass{};
+    uint32_t classCount = 1; // class 0: bytes in no pattern
+    std::vector<uint32_t> transitions; // state * classCount + class
+    // patterns ending in a state, including those of its suffix states
+    std::vector<uint32_t> outputBegin;
+    std::vector<uint32_t> outputs;
+};
+
+// how the requested names are compared with directory entries
+enum class MatchMode {
+    Name,     // whole filename, plain or glob
+    Contains, // filename contains the pattern (--contains)
+    Regex,    // extended regular expression found in the filename (--regex)
+};
+
+// all requested filenames: plain names are looked up in a hash map keyed by the
+// (case-folded with -i) name, so every entry costs one lookup no matter how many names
+// there are, and only patterns that are globs are tried one by one
+class NameMatcher {
+public:
+    NameMatcher(const std::vector<std::string>& patterns, bool ignoreCase, MatchMode mode = MatchMode::Name);
+
+    const std::vector<std::string>& patterns() const { return patternList; }
+    // true if every pattern is a plain name, which lets indexes look names up directly
+    bool plainNamesOnly() const { return globs.empty() && !substrings && regexes.empty(); }
+    // --regex: the compiled expressions, in pattern order
+    const std::vector<std::unique_ptr<RegexPattern>>& regexPatterns() const { return regexes; }
+    // time every regex match for --stats
+    void measureTime(bool enabled);
+
+    // call visitor with the index of every pattern matching name, true if there was one
+    template <typename Visitor>
+    bool forEachMatch(std::string_view name, Visitor&& visitor) const {
+        bool matched = false;
+        if (substrings) {
+            thread_local std::vector<uint32_t> contained;
+            substrings->find(name, contained);
+            for (uint32_t index : contained) {
+                visitor(static_cast<size_t>(index));
+            }
+            return !contained.empty();
+        }
+        for (size_t i = 0; i < regexes.size(); ++i) {
+            if (regexes[i]->matches(name)) {
+                visitor(i);
+                matched = true;
+            }
+        }
+        if (hasPlainNames) {
+            if (const std::vector<size_t>* indices = findExact(name)) {
+                for (size_t index : *indices) {
+                    visitor(index);
+                }
+                matched = true;
+            }
+        }
+        for (const auto& glob : globs) {
+            if (glob.first.matches(name)) {
+                visitor(glob.second);
+                matched = true;
+            }
+        }
+        return matched;
+    }
+
+private:
+    // a handful of names is compared directly, hashing only pays off for more
+    static constexpr size_t maximumFewNames = 8;
+
+    struct PlainName {
+        std::string key; // case-folded with -i
+        std::vector<size_t> indices;
+    };
+
+    const std::vector<size_t>* findExact(std::string_view name) const;
+    bool hasLength(size_t size) const {
+        size = size < 255 ? size : 255;
+        return (lengths[size >> 6] >> (size & 63)) & 1;
+    }
+
+    bool ignoreCase;
+    std::vector<std::string> patternList;
+    bool hasPlainNames = false;
+    // bit n: some plain name is n bytes long, bit 255 stands for all longer ones
+    std::array<uint64_t, 4> lengths{};
+    std::vector<PlainName> fewNames;
+    std::unordered_map<std::string, std::vector<size_t>> exact; // key -> indices into patternList
+    std::vector<std::pair<GlobPattern, size_t>> globs;
+    std::unique_ptr<SubstringMatcher> substrings; // --contains
+    std::vector<std::unique_ptr<RegexPattern>> regexes; // --regex
+};
+
+// --prune: directories that are not descended into. Patterns with a '/' are globs over the
+// whole path (where '*' also matches '/', like find -path), the others go through the same
+// NameMatcher as the searched filenames
+class PruneRules {
+public:
+    PruneRules(const std::vector<std::string>& patterns, bool ignoreCase);
+
+    bool empty() const { return names.patterns().empty() && paths.empty(); }
+    bool matches(std::string_view path, std::string_view name) const;
+
+private:
+    static std::vector<std::string> namePatterns(const std::vector<std::string>& patterns);
+
+    NameMatcher names;
+    std::vector<GlobPattern> paths;
+};
+
+#endif
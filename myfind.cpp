@@ -1,131 +1,621 @@
 #include <iostream>
+#include <algorithm>
+#include <climits>
 #include <vector>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <filesystem>
-#include <semaphore.h>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <deque>
+#include <memory>
+
+#include "daemon.hpp"
+#include "index.hpp"
+#include "output.hpp"
+#include "search.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 namespace fs = std::filesystem;
 
 // global variables
-bool recursiveSearchEnabled = false;
-bool caseInsensetiveSearch = false;
+SearchOptions searchOptions; // what to search for and how, filled in from the options
+bool singleWalkEnabled = false;
+std::string buildIndexFile; // --build-index: write an index instead of searching
+std::string updateIndexFile; // --update-index: refresh an index
+bool daemonMode = false;     // --daemon: keep the tree in memory and serve queries
+bool daemonAllowed = true;   // --no-daemon: always walk the tree
+std::string socketPath;      // --socket: where the daemon listens
+bool statsEnabled = false;   // --stats: report walk and matcher statistics on stderr
+bool statsJson = false;      // --stats=json: as one JSON object instead of text lines
+std::string traceFile;       // --trace: write a Chrome trace of all directory visits here
+bool streamOutput = false;   // stdout is a terminal: lines are written as soon as they are found
+
+// options without a short form
+enum LongOption {
+    optionBackend = 256,
+    optionBuildIndex,
+    optionIndex,
+    optionUpdateIndex,
+    optionDaemon,
+    optionNoDaemon,
+    optionSocket,
+    optionContains,
+    optionRegex,
+    optionStats,
+    optionFirst,
+    optionOrder,
+    optionMinDepth,
+    optionMaxDepth,
+    optionPrune,
+    optionRespectIgnore,
+    optionSameDevice,
+    optionDeviceJobs,
+    optionUringDepth,
+    optionType,
+    optionPermission,
+    optionSize,
+    optionModified,
+    optionNewer,
+    optionTrace,
+};
 
-// track number of active child processes
-sem_t semaphore;
+// size of the parent's reads from the child pipes and of its output batches
+constexpr size_t outputBatchSize = 64 * 1024;
 
 // display how to properly search
 void printUsage(const char* programName) {
-    std::cerr << "Usage: " << programName << " [-R] [-i] searchpath filename1 [filename2] ...\n"
+    std::cerr << "Usage: " << programName << " [-R] [-L] [-i] [-s] [-j N] [-n N | --first] [--contains | --regex] [--stats[=text|json]] [--trace FILE] [--order=dfs|bfs] [--mindepth N] [--maxdepth N] [--prune GLOB]... [--respect-ignore] [-xdev] [-type C] [-size [+-]N[ckMG]] [-mtime [+-]N] [-newer FILE] [-perm [-/]MODE] [--device-jobs [PATH=]N]... [--backend=getdents|uring|std] [--uring-depth N] [--build-index FILE | --index FILE] searchpath pattern1 [pattern2] ...\n"
+              << "       " << programName << " [-j N] --update-index FILE\n"
+              << "       " << programName << " --daemon [--socket PATH] searchpath\n"
               << "Options:\n"
               << "  -R  Search directories recursively\n"
-              << "  -i  Perform case-insensitive filename matching\n";
+              << "  -L  Follow symbolic links to directories, each directory is searched once\n"
+              << "  -i  Perform case-insensitive filename matching\n"
+              << "  -s  Search for all filenames in a single traversal\n"
+              << "  -j  Walk the tree with N threads (implies -s, 0 uses all cores, at most 4 per core)\n"
+              << "  -n  Stop searching once every filename was found N times\n"
+              << "  --first  Same as -n 1\n"
+              << "  --contains  Match filenames that contain a pattern anywhere\n"
+              << "  --regex  Patterns are extended regular expressions searched in filenames\n"
+              << "  --stats  Report directories, entries, stat calls, time and throughput per thread and of\n"
+              << "           every regex on stderr, --stats=json as one JSON object per search process\n"
+              << "  --trace FILE  Write every directory visit as Chrome trace JSON (chrome://tracing, Perfetto);\n"
+              << "                without -s each filename's search writes FILE.<pid>; not with an index,\n"
+              << "                and nothing is written if a daemon answers\n"
+              << "  --order  Walk depth-first (dfs, default) or breadth-first (bfs), which reports shallow matches first\n"
+              << "  --mindepth  Only report entries at least N levels below searchpath (1: its own entries)\n"
+              << "  --maxdepth  Descend at most N levels below searchpath (implies -R)\n"
+              << "  --prune  Do not descend into directories matching GLOB, a GLOB with '/' matches the whole path\n"
+              << "  --respect-ignore  Skip files and directories excluded by .gitignore and .ignore files\n"
+              << "  -xdev  Do not descend into directories on other filesystems\n"
+              << "  -type  Only report entries of type C: f, d, l, b, c, p, s or a list like f,l\n"
+              << "  -size  Only report files of N units (c bytes, k KiB, M MiB, G GiB, default 512 byte blocks),\n"
+              << "         +N for more, -N for less\n"
+              << "  -mtime  Only report entries modified N days ago, +N for longer, -N for more recently\n"
+              << "  -newer  Only report entries modified after FILE\n"
+              << "  -perm  Only report entries with exactly the octal MODE, -MODE for all of its bits, /MODE for any\n"
+              << "  --device-jobs  At most N threads read directories of one device at a time,\n"
+              << "                 PATH=N sets the limit for the device PATH is on\n"
+              << "  --backend  How directories are read, by -s/-j and by the child of each filename:\n"
+              << "             getdents (default), uring (getdents with opens and lookups batched through\n"
+              << "             io_uring, getdents if unavailable) or std (std::filesystem); -size, -mtime,\n"
+              << "             -newer and -perm look up each matching entry with its own statx on every backend\n"
+              << "  --uring-depth  Operations per io_uring submission (default 64)\n"
+              << "  --build-index FILE  Index everything below searchpath into FILE\n"
+              << "  --index FILE  Answer the search from FILE instead of walking the tree\n"
+              << "  --update-index FILE  Refresh FILE, reading only directories that changed\n"
+              << "  --daemon  Keep searchpath in memory, follow changes and answer searches\n"
+              << "  --socket PATH  Socket of the daemon (default " << defaultSocketPath() << ")\n"
+              << "  --no-daemon  Walk the tree even if a daemon is running\n";
 }
 
-// compare filenames, optionally case-insensitive 
-bool isMatchingFilename(const std::string& file1, const std::string& file2) {
-    if (caseInsensetiveSearch) {
-        // compare filenames ignoring case
-        return strcasecmp(file1.c_str(), file2.c_str()) == 0;
+// parse the value of --backend
+bool parseBackend(const char* name, Backend& backend) {
+    if (strcmp(name, "getdents") == 0) {
+        backend = Backend::Getdents;
+    } else if (strcmp(name, "uring") == 0) {
+        backend = Backend::Uring;
+    } else if (strcmp(name, "std") == 0) {
+        backend = Backend::Filesystem;
+    } else {
+        return false;
     }
-    // case-sensitive comparison
-    return file1 == file2;
+    return true;
 }
 
-// search for file in directory
-void searchForFile(const std::string& directory, const std::string& filename) {
-    bool found = false;
+// parse the value of --order
+bool parseOrder(const char* name, Order& order) {
+    if (strcmp(name, "dfs") == 0) {
+        order = Order::DepthFirst;
+    } else if (strcmp(name, "bfs") == 0) {
+        order = Order::BreadthFirst;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-    try {
-        if (recursiveSearchEnabled) {
-            // recursive search through all subdirectories
-            for (const auto& entry : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied)) {
-                if (isMatchingFilename(entry.path().filename().string(), filename)) {
-                    sem_wait(&semaphore); 
-                    std::cout << getpid() << ": " << filename << ": " << fs::absolute(entry.path()) << "\n";
-                    sem_post(&semaphore); 
-                    found = true;
-                }
+// parse a non-negative depth for --mindepth / --maxdepth
+bool parseDepth(const char* text, int& depth) {
+    char* end = nullptr;
+    long value = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || value < 0 || value > INT_MAX) {
+        return false;
+    }
+    depth = static_cast<int>(value);
+    return true;
+}
+
+// parse the value of --device-jobs, "N" or "PATH=N"
+bool parseDeviceJobs(const std::string& value) {
+    size_t equals = value.rfind('=');
+    std::string count = equals == std::string::npos ? value : value.substr(equals + 1);
+    char* end = nullptr;
+    long jobs = strtol(count.c_str(), &end, 10);
+    if (count.empty() || *end != '\0' || jobs < 0 || jobs > INT_MAX) {
+        return false;
+    }
+    if (equals == std::string::npos) {
+        searchOptions.deviceJobs = static_cast<unsigned>(jobs);
+    } else {
+        searchOptions.deviceJobsFor.emplace_back(value.substr(0, equals), static_cast<unsigned>(jobs));
+    }
+    return true;
+}
+
+// write the whole buffer, retrying after partial writes and signals
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// "<pid>: <filename>: "<path>"" for a match below root
+void appendMatch(OutputBuffer& output, const std::string& pidPrefix, const std::string& filename,
+                 std::string_view root, std::string_view path) {
+    output.append(pidPrefix);
+    output.append(filename);
+    output.append(": ");
+    output.appendQuotedPath(root, path);
+    output.append("\n");
+    output.endLine();
+}
+
+// "<pid>: <filename>: Not found in "<root>""
+void appendNotFound(OutputBuffer& output, const std::string& pidPrefix, const std::string& filename, std::string_view root) {
+    output.append(pidPrefix);
+    output.append(filename);
+    output.append(": Not found in ");
+    output.appendQuotedPath(root, "");
+    output.append("\n");
+    output.endLine();
+}
+
+// --stats: the report on stderr, as text or JSON
+void printStatistics(const SearchSummary& summary, const NameMatcher& names) {
+    std::string text = statsJson ? formatStatisticsJson(summary.statistics, names, getpid(), summary.source)
+                                 : formatStatistics(summary.statistics, names, getpid(), summary.source);
+    writeAll(STDERR_FILENO, text.data(), text.size());
+}
+
+// run the search and print every match, a "Not found" line for every filename without one and
+// the --trace and --stats reports; with daemonOnly only a running daemon is asked, nothing is
+// printed and false returned if it cannot answer
+bool printSearch(Searcher& searcher, bool daemonOnly = false) {
+    const SearchOptions& options = searcher.options();
+    const std::string pidPrefix = std::to_string(getpid()) + ": ";
+    const std::vector<std::string>& filenames = options.filenames;
+
+    OutputSink sink(STDOUT_FILENO);
+    std::deque<OutputBuffer> buffers; // one per worker, nothing to lock until a flush
+    for (unsigned i = 0; i < std::max(1u, options.threads); ++i) {
+        // flush size 0 writes every line right away
+        if (streamOutput) {
+            buffers.emplace_back(sink, 0);
         } else {
-            // non-recursive search only in the specified directory
-            for (const auto& entry : fs::directory_iterator(directory, fs::directory_options::skip_permission_denied)) {
-                if (isMatchingFilename(entry.path().filename().string(), filename)) {
-                    sem_wait(&semaphore);
-                    std::cout << getpid() << ": " << filename << ": " << fs::absolute(entry.path()) << "\n";
-                    sem_post(&semaphore);
-                    found = true;
+            buffers.emplace_back(sink);
+        }
+    }
+    std::mutex errorLock;
+
+    auto print = [&](const SearchResult& result) {
+        appendMatch(buffers[result.worker], pidPrefix, filenames[result.pattern], result.directory, result.name);
+    };
+    auto reportError = [&](const std::string& path, const std::string& message) {
+        // one write so the line cannot be split by another process writing to stderr
+        std::string line = "Error accessing " + path + ": " + message + "\n";
+        std::lock_guard<std::mutex> guard(errorLock);
+        writeAll(STDERR_FILENO, line.data(), line.size());
+    };
+
+    SearchSummary summary;
+    if (daemonOnly) {
+        if (!searcher.askDaemon(print, summary)) {
+            return false;
+        }
+    } else {
+        summary = searcher.run(print, reportError);
+    }
+
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        if (summary.hits[i] == 0) {
+            appendNotFound(buffers[0], pidPrefix, filenames[i], summary.root);
+        }
+    }
+    for (auto& buffer : buffers) {
+        buffer.flush();
+    }
+    if (options.trace != nullptr && summary.source == SearchSource::Walk) {
+        // the children of a search without -s would all write the same file
+        std::string file = singleWalkEnabled ? traceFile : traceFile + "." + std::to_string(getpid());
+        if (!options.trace->write(file, getpid())) {
+            reportError(file, strerror(errno));
+        }
+    } else if (options.trace != nullptr) {
+        // only an index can be the source otherwise, and --trace is refused with one
+        std::string line = "Warning: the daemon answered, no walk to trace and " + traceFile +
+                           " not written; --no-daemon walks the tree\n";
+        writeAll(STDERR_FILENO, line.data(), line.size());
+    }
+    if (statsEnabled) {
+        printStatistics(summary, searcher.names());
+    }
+    return true;
+}
+
+// read end of the pipe a child process writes its results to
+struct ChildChannel {
+    int fd;
+    std::string pending; // output after the last complete line
+};
+
+// drain the pipes of all children until every child closed its end; only complete
+// lines are copied to stdout, in large batches (right away on a terminal), so lines of
+// different children never mix
+void collectChildOutput(std::vector<ChildChannel>& channels) {
+    std::vector<pollfd> pollFds;
+    for (const auto& channel : channels) {
+        pollFds.push_back(pollfd{channel.fd, POLLIN, 0});
+    }
+
+    std::string batch;
+    std::vector<char> buffer(outputBatchSize);
+    size_t open = channels.size();
+
+    while (open > 0) {
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (size_t i = 0; i < pollFds.size(); ++i) {
+            if (pollFds[i].fd < 0 || pollFds[i].revents == 0) {
+                continue;
+            }
+            ChildChannel& channel = channels[i];
+            ssize_t bytes = read(channel.fd, buffer.data(), buffer.size());
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (bytes > 0) {
+                channel.pending.append(buffer.data(), bytes);
+                size_t end = channel.pending.rfind('\n');
+                if (end != std::string::npos) {
+                    batch.append(channel.pending, 0, end + 1);
+                    channel.pending.erase(0, end + 1);
+                }
+            } else {
+                // child is done, a last unterminated line is still passed on whole
+                if (!channel.pending.empty()) {
+                    batch += channel.pending;
+                    batch += '\n';
+                    channel.pending.clear();
                 }
+                close(channel.fd);
+                pollFds[i].fd = -1;
+                --open;
             }
         }
 
-        if (!found) {
-            sem_wait(&semaphore);
-            std::cout << getpid() << ": " << filename << ": Not found in " << fs::absolute(directory) << "\n";
-            sem_post(&semaphore);
+        if (batch.size() >= outputBatchSize || open == 0 || (streamOutput && !batch.empty())) {
+            writeAll(STDOUT_FILENO, batch.data(), batch.size());
+            batch.clear();
         }
-    } catch (const std::exception& e) {
-        sem_wait(&semaphore);
-        std::cerr << "Error accessing " << directory << ": " << e.what() << "\n";
-        sem_post(&semaphore);
+    }
+    if (!batch.empty()) {
+        writeAll(STDOUT_FILENO, batch.data(), batch.size());
     }
 }
+
 /*
  how requirement was achieved:
- - Creates a child process with 'fork()' for each filename.
- - Child process searches the directory (recursively if '-R' is enabled, case insensetive if '-i' is enabled).
+ - Creates a child process with 'fork()' for each filename, or with '-s' / '-j N' walks the tree
+   once for all filenames.
+ - Child process searches the directory (recursively if '-R' is enabled, case insensetive if '-i' is enabled)
+   with the walker of '--backend'.
  - Results printed to 'stdout': process ID, filename, file path, or "Not found".
+ - Every child writes its results into its own pipe, the parent prints only complete lines.
  - Parent process waits for all children to finish using 'waitpid'.
- - Output is unsorted but readable, as each child prints results immediately.
+ - Output is unsorted but readable, as results are passed on while the children are still searching.
+ - The search itself is libmyfind (see search.hpp), this file parses the options and prints the results.
  */
 int main(int argc, char* argv[]) {
     int opt;
     bool optionError = false;
 
-    // ensure correct synchronization between parent and child processes
-    sem_init(&semaphore, 0, 1);
-
-    // to check if -R or -i are already set
+    // to check if -R, -L, -i or -s are already set
     bool doubleR = false;
+    bool doubleL = false;
     bool doubleI = false;
+    bool doubleS = false;
+
+    static const struct option longOptions[] = {
+        {"backend", required_argument, nullptr, optionBackend},
+        {"build-index", required_argument, nullptr, optionBuildIndex},
+        {"index", required_argument, nullptr, optionIndex},
+        {"update-index", required_argument, nullptr, optionUpdateIndex},
+        {"daemon", no_argument, nullptr, optionDaemon},
+        {"no-daemon", no_argument, nullptr, optionNoDaemon},
+        {"socket", required_argument, nullptr, optionSocket},
+        {"contains", no_argument, nullptr, optionContains},
+        {"regex", no_argument, nullptr, optionRegex},
+        {"stats", optional_argument, nullptr, optionStats},
+        {"first", no_argument, nullptr, optionFirst},
+        {"order", required_argument, nullptr, optionOrder},
+        {"mindepth", required_argument, nullptr, optionMinDepth},
+        {"maxdepth", required_argument, nullptr, optionMaxDepth},
+        {"prune", required_argument, nullptr, optionPrune},
+        {"respect-ignore", no_argument, nullptr, optionRespectIgnore},
+        {"xdev", no_argument, nullptr, optionSameDevice},
+        {"device-jobs", required_argument, nullptr, optionDeviceJobs},
+        {"uring-depth", required_argument, nullptr, optionUringDepth},
+        {"type", required_argument, nullptr, optionType},
+        {"perm", required_argument, nullptr, optionPermission},
+        {"size", required_argument, nullptr, optionSize},
+        {"mtime", required_argument, nullptr, optionModified},
+        {"newer", required_argument, nullptr, optionNewer},
+        {"trace", required_argument, nullptr, optionTrace},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    // find spells some long options with a single dash
+    static const char* const findOptions[] = {"xdev", "type", "perm", "size", "mtime", "newer"};
+    std::vector<std::string> doubleDash(argc);
+    for (int i = 1; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+        for (const char* option : findOptions) {
+            if (argv[i][0] == '-' && strcmp(argv[i] + 1, option) == 0) {
+                doubleDash[i] = std::string("-") + argv[i];
+                argv[i] = &doubleDash[i][0];
+            }
+        }
+    }
 
     // parse command-line options
-    while ((opt = getopt(argc, argv, "Ri")) != EOF) {
+    const char* lastArgument = nullptr; // argument of the last option, may start with '-' (-size -10k)
+    static const char shortOptions[] = "RLisj:n:";
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, nullptr)) != EOF) {
+        lastArgument = optarg;
         switch (opt) {
             case 'R':
                  if (doubleR) { // check if -R was already set
                     optionError = true;
                     std::cerr << "Error: Option -R is specified multiple times.\n";
                 }
-                recursiveSearchEnabled = true;
+                searchOptions.recursive = true;
                 doubleR = true;
                 break;
+            case 'L':
+                 if (doubleL) { // check if -L was already set
+                    optionError = true;
+                    std::cerr << "Error: Option -L is specified multiple times.\n";
+                }
+                searchOptions.followSymlinks = true;
+                doubleL = true;
+                break;
             case 'i':
                  if (doubleI) { // check if -i was already set
                     optionError = true;
                     std::cerr << "Error: Option -i is specified multiple times.\n";
                 }
-                caseInsensetiveSearch = true;
+                searchOptions.ignoreCase = true;
                 doubleI = true;
                 break;
+            case 's':
+                 if (doubleS) { // check if -s was already set
+                    optionError = true;
+                    std::cerr << "Error: Option -s is specified multiple times.\n";
+                }
+                singleWalkEnabled = true;
+                doubleS = true;
+                break;
+            case 'j': {
+                char* end = nullptr;
+                long threads = strtol(optarg, &end, 10);
+                // more threads than that only add contention for the shared queue
+                const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+                if (*optarg == '\0' || *end != '\0' || threads < 0 || threads > 4 * static_cast<long>(cores)) {
+                    optionError = true;
+                    std::cerr << "Error: Option -j needs a thread count from 0 to " << 4 * cores << ".\n";
+                    break;
+                }
+                searchOptions.threads = threads == 0 ? cores : static_cast<unsigned>(threads);
+                singleWalkEnabled = true;
+                break;
+            }
+            case 'n': {
+                char* end = nullptr;
+                long limit = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || limit <= 0) {
+                    optionError = true;
+                    std::cerr << "Error: Option -n needs a positive number of hits.\n";
+                    break;
+                }
+                searchOptions.hitLimit = static_cast<size_t>(limit);
+                break;
+            }
+            case optionFirst:
+                searchOptions.hitLimit = 1;
+                break;
+            case optionOrder:
+                if (!parseOrder(optarg, searchOptions.order)) {
+                    optionError = true;
+                    std::cerr << "Error: Unknown order " << optarg << ", use dfs or bfs.\n";
+                }
+                break;
+            case optionMinDepth:
+            case optionMaxDepth:
+                if (!parseDepth(optarg, opt == optionMinDepth ? searchOptions.minDepth : searchOptions.maxDepth)) {
+                    optionError = true;
+                    std::cerr << "Error: Option --" << (opt == optionMinDepth ? "mindepth" : "maxdepth")
+                              << " needs a non-negative depth.\n";
+                }
+                break;
+            case optionPrune:
+                searchOptions.prunePatterns.push_back(optarg);
+                break;
+            case optionRespectIgnore:
+                searchOptions.respectIgnore = true;
+                break;
+            case optionSameDevice:
+                searchOptions.sameDevice = true;
+                break;
+            case optionDeviceJobs:
+                if (!parseDeviceJobs(optarg)) {
+                    optionError = true;
+                    std::cerr << "Error: Option --device-jobs needs N or PATH=N with a non-negative N.\n";
+                }
+                break;
+            case optionBackend:
+                if (!parseBackend(optarg, searchOptions.backend)) {
+                    optionError = true;
+                    std::cerr << "Error: Unknown backend " << optarg << ", use getdents, uring or std.\n";
+                }
+                break;
+            case optionUringDepth: {
+                int depth = 0;
+                if (!parseDepth(optarg, depth) || depth == 0 || depth > 4096) {
+                    optionError = true;
+                    std::cerr << "Error: Option --uring-depth needs a number from 1 to 4096.\n";
+                } else {
+                    searchOptions.uringDepth = static_cast<unsigned>(depth);
+                }
+                break;
+            }
+            case optionBuildIndex:
+                buildIndexFile = optarg;
+                break;
+            case optionIndex:
+                searchOptions.indexFile = optarg;
+                break;
+            case optionUpdateIndex:
+                updateIndexFile = optarg;
+                break;
+            case optionDaemon:
+                daemonMode = true;
+                break;
+            case optionNoDaemon:
+                daemonAllowed = false;
+                break;
+            case optionSocket:
+                socketPath = optarg;
+                break;
+            case optionContains:
+                searchOptions.matchMode = MatchMode::Contains;
+                break;
+            case optionRegex:
+                searchOptions.matchMode = MatchMode::Regex;
+                break;
+            case optionStats:
+                statsEnabled = true;
+                if (optarg != nullptr && strcmp(optarg, "json") != 0 && strcmp(optarg, "text") != 0) {
+                    optionError = true;
+                    std::cerr << "Error: Unknown --stats format " << optarg << ", use text or json.\n";
+                }
+                statsJson = optarg != nullptr && strcmp(optarg, "json") == 0;
+                break;
+            case optionType:
+                searchOptions.metadataPredicates.emplace_back("type", optarg);
+                break;
+            case optionPermission:
+                searchOptions.metadataPredicates.emplace_back("perm", optarg);
+                break;
+            case optionSize:
+                searchOptions.metadataPredicates.emplace_back("size", optarg);
+                break;
+            case optionModified:
+                searchOptions.metadataPredicates.emplace_back("mtime", optarg);
+                break;
+            case optionNewer:
+                searchOptions.metadataPredicates.emplace_back("newer", optarg);
+                break;
+            case optionTrace:
+                traceFile = optarg;
+                break;
             default:
                 optionError = true; // flag an error for invalid options
                 break;
         }
     }
 
-    // combined options like -Ri are not allowed (must be separate)
-    if (optind > 1 && argv[optind - 1][0] == '-' && strlen(argv[optind - 1]) > 2) {
-        std::cerr << "Error: Options -R and -i must be written separately.\n";
+    // combined options like -Ri are not allowed (must be separate); an option with an
+    // argument may have it attached (-j4)
+    const char* lastOption = optind > 1 ? argv[optind - 1] : nullptr;
+    const char* shortOption = lastOption != nullptr && lastOption[0] == '-' && lastOption[1] != '-' && lastOption[1] != '\0'
+                                  ? strchr(shortOptions, lastOption[1])
+                                  : nullptr;
+    bool takesArgument = shortOption != nullptr && shortOption[1] == ':';
+    if (lastOption != nullptr && lastOption != lastArgument && lastOption[0] == '-' && lastOption[1] != '-' && !takesArgument && strlen(lastOption) > 2) {
+        std::cerr << "Error: Options -R, -L, -i and -s must be written separately.\n";
+        return EXIT_FAILURE;
+    }
+
+    if (socketPath.empty()) {
+        socketPath = defaultSocketPath();
+    }
+    if (searchOptions.maxDepth > 0 && searchOptions.minDepth > searchOptions.maxDepth) {
+        std::cerr << "Error: --mindepth is larger than --maxdepth.\n";
         return EXIT_FAILURE;
     }
 
+    // someone is watching: results are shown as they come instead of in large batches
+    streamOutput = isatty(STDOUT_FILENO);
+
+    // an index knows its own search path
+    if (!optionError && !updateIndexFile.empty() && optind == argc) {
+        try {
+            updateIndex(updateIndexFile, searchOptions.threads, searchOptions.backend);
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     // validate arguments and options
-    if (optionError || optind >= argc) {
+    if (optionError || optind >= argc || !updateIndexFile.empty()) {
         printUsage(argv[0]);
-        sem_destroy(&semaphore);
         return EXIT_FAILURE;
     }
 
@@ -136,31 +626,109 @@ int main(int argc, char* argv[]) {
     // check if search path exists and is valid directory
     if (!fs::exists(searchPath) || !fs::is_directory(searchPath)) {
         std::cerr << "Error: Invalid or non-existent directory: " << searchPath << "\n";
-        sem_destroy(&semaphore);
         return EXIT_FAILURE;
     }
 
+    if (!buildIndexFile.empty() && !searchOptions.indexFile.empty()) {
+        std::cerr << "Error: --build-index and --index cannot be combined.\n";
+        return EXIT_FAILURE;
+    }
+    if ((searchOptions.respectIgnore || searchOptions.followSymlinks) && (!buildIndexFile.empty() || !searchOptions.indexFile.empty())) {
+        std::cerr << "Error: --respect-ignore and -L only apply to a walk of the tree and cannot be combined with an index.\n";
+        return EXIT_FAILURE;
+    }
+    if (!traceFile.empty() && (!buildIndexFile.empty() || !searchOptions.indexFile.empty())) {
+        std::cerr << "Error: --trace only records a walk of the tree and cannot be combined with an index.\n";
+        return EXIT_FAILURE;
+    }
+
+    searchOptions.root = searchPath;
+    searchOptions.filenames = filenames;
+    searchOptions.measureTime = statsEnabled;
+    if (daemonAllowed && !daemonMode) {
+        searchOptions.daemonSocket = socketPath;
+    }
+    std::unique_ptr<TraceRecorder> trace;
+    if (!traceFile.empty()) {
+        trace = std::make_unique<TraceRecorder>(searchOptions.threads);
+        searchOptions.trace = trace.get();
+    }
+
+    // compiled before anything else runs, so a bad pattern is reported once and not by every child
+    std::unique_ptr<Searcher> searcher;
+    try {
+        if (!buildIndexFile.empty()) {
+            buildIndex(buildIndexFile, searchPath, searchOptions.threads, searchOptions.backend);
+            return 0;
+        }
+        searcher = std::make_unique<Searcher>(searchOptions);
+        if (!searchOptions.indexFile.empty()) {
+            printSearch(*searcher);
+            return 0;
+        }
+        if (daemonMode) {
+            return runDaemon(normalizeRoot(searchPath), socketPath);
+        }
+        // a running daemon answers for all filenames at once, children are only forked without one
+        if (!singleWalkEnabled && printSearch(*searcher, true)) {
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // walk the tree once for all filenames, unless a daemon answers
+    if (singleWalkEnabled) {
+        printSearch(*searcher);
+        return 0;
+    }
+
+    // nothing may be left in the stdout buffer that the children would inherit
+    std::cout.flush();
+    std::vector<ChildChannel> channels;
+
     // create child process for each filename
     for (const auto& filename : filenames) {
+        int pipeFds[2];
+        if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+            std::cerr << "Error: Failed to create pipe for " << filename << "\n";
+            continue;
+        }
+
         pid_t pid = fork();
 
         if (pid == 0) {
-            searchForFile(searchPath, filename);
+            // results go through the pipe
+            for (const auto& channel : channels) {
+                close(channel.fd);
+            }
+            close(pipeFds[0]);
+            dup2(pipeFds[1], STDOUT_FILENO);
+            close(pipeFds[1]);
+
+            // a search of its own for just this filename, the daemon was already asked
+            SearchOptions options = searchOptions;
+            options.filenames = {filename};
+            options.daemonSocket.clear();
+            Searcher single(std::move(options));
+            printSearch(single);
             return 0;
         } else if (pid < 0) {
-            sem_wait(&semaphore);
             std::cerr << "Error: Failed to create process for " << filename << "\n";
-            sem_post(&semaphore);
+            close(pipeFds[0]);
+        } else {
+            channels.push_back(ChildChannel{pipeFds[0], {}});
         }
+        close(pipeFds[1]);
     }
 
+    collectChildOutput(channels);
+
     for (size_t i = 0; i < filenames.size(); ++i) {
         int status;
         waitpid(-1, &status, 0); // wait for any child process
     }
 
-    // clean up after all processes have finished
-    sem_destroy(&semaphore);
-
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,165 @@
+#include "output.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+
+namespace {
+
+constexpr size_t chunkSize = 64 * 1024;
+
+// length of the well-formed UTF-8 sequence at the start of text, 0 if there is none;
+// overlong forms, surrogates and code points past U+10FFFF are not well-formed
+size_t utf8Length(std::string_view text) {
+    const auto byte = [&](size_t i) { return static_cast<unsigned char>(text[i]); };
+    const unsigned char lead = byte(0);
+    size_t length;
+    unsigned char low = 0x80, high = 0xbf; // range of the second byte
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        length = 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        length = 3;
+        low = lead == 0xe0 ? 0xa0 : 0x80;
+        high = lead == 0xed ? 0x9f : 0xbf;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        length = 4;
+        low = lead == 0xf0 ? 0x90 : 0x80;
+        high = lead == 0xf4 ? 0x8f : 0xbf;
+    } else {
+        return 0;
+    }
+    if (text.size() < length || byte(1) < low || byte(1) > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; ++i) {
+        if (byte(i) < 0x80 || byte(i) > 0xbf) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+}
+
+bool OutputSink::write(const std::vector<std::string>& pieces, size_t count) {
+    std::vector<iovec> vectors;
+    vectors.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!pieces[i].empty()) {
+            vectors.push_back(iovec{const_cast<char*>(pieces[i].data()), pieces[i].size()});
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    size_t next = 0;
+    while (next < vectors.size()) {
+        int batch = static_cast<int>(std::min<size_t>(vectors.size() - next, IOV_MAX));
+        ssize_t written = writev(fd, &vectors[next], batch);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // skip what was written, a partially written piece continues where it stopped
+        while (next < vectors.size() && static_cast<size_t>(written) >= vectors[next].iov_len) {
+            written -= vectors[next].iov_len;
+            ++next;
+        }
+        if (written > 0) {
+            vectors[next].iov_base = static_cast<char*>(vectors[next].iov_base) + written;
+            vectors[next].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+OutputBuffer::OutputBuffer(OutputSink& sink, size_t flushSize) : sink(&sink), flushSize(flushSize) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+std::string& OutputBuffer::reserve(size_t size) {
+    if (used == 0 || chunks[used - 1].size() + size > chunkSize) {
+        if (used == chunks.size()) {
+            chunks.emplace_back();
+            chunks.back().reserve(chunkSize);
+        }
+        ++used;
+    }
+    bytes += size;
+    return chunks[used - 1];
+}
+
+void OutputBuffer::append(std::string_view text) {
+    reserve(text.size()).append(text);
+}
+
+void OutputBuffer::appendQuoted(std::string_view text) {
+    std::string& chunk = reserve(text.size());
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '"' || text[i] == '\\') {
+            chunk.append(text, start, i - start);
+            chunk += '\\';
+            start = i;
+            ++bytes;
+        }
+    }
+    chunk.append(text, start, text.size() - start);
+}
+
+void OutputBuffer::appendQuotedPath(std::string_view directory, std::string_view name) {
+    append("\"");
+    appendQuoted(directory);
+    if (!name.empty()) {
+        if (directory.empty() || directory.back() != '/') {
+            append("/");
+        }
+        appendQuoted(name);
+    }
+    append("\"");
+}
+
+void OutputBuffer::flush() {
+    if (bytes == 0) {
+        return;
+    }
+    sink->write(chunks, used);
+    for (size_t i = 0; i < used; ++i) {
+        chunks[i].clear();
+    }
+    used = 0;
+    bytes = 0;
+}
+
+void appendJsonString(std::string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (size_t i = 0; i < text.size();) {
+        const unsigned char c = text[i];
+        if (c >= 0x80) {
+            // names are bytes, not necessarily UTF-8: a byte outside a well-formed sequence
+            // becomes \u00XX, so the report stays valid JSON and the byte can be told apart
+            size_t length = utf8Length(text.substr(i));
+            if (length > 0) {
+                out.append(text.data() + i, length);
+                i += length;
+                continue;
+            }
+        }
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x80) {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        } else {
+            out += static_cast<char>(c);
+        }
+        ++i;
+    }
+    out += '"';
+}
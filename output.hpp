@@ -0,0 +1,57 @@
+#ifndef MYFIND_OUTPUT_HPP
+#define MYFIND_OUTPUT_HPP
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// file descriptor shared by several output buffers, each flush is written under a lock
+class OutputSink {
+public:
+    explicit OutputSink(int fd) : fd(fd) {}
+
+    // write all pieces with as few writev calls as possible
+    bool write(const std::vector<std::string>& pieces, size_t count);
+
+private:
+    int fd;
+    std::mutex lock;
+};
+
+// text as a JSON string literal in double quotes, for the --stats=json and --trace reports;
+// bytes that are not part of well-formed UTF-8 are written as \u00XX
+void appendJsonString(std::string& out, std::string_view text);
+
+// per-worker output buffer: lines are formatted into 64 KiB chunks and handed to the
+// sink in one writev once enough of them piled up, always ending on a complete line
+class OutputBuffer {
+public:
+    explicit OutputBuffer(OutputSink& sink, size_t flushSize = 1024 * 1024);
+    ~OutputBuffer();
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void append(std::string_view text);
+    // directory + '/' + name in double quotes with '"' and '\' escaped, like std::quoted
+    void appendQuotedPath(std::string_view directory, std::string_view name);
+    // call after every complete line, flushes once the buffer is full
+    void endLine() {
+        if (bytes >= flushSize) {
+            flush();
+        }
+    }
+    void flush();
+
+private:
+    std::string& reserve(size_t size);
+    void appendQuoted(std::string_view text);
+
+    OutputSink* sink;
+    size_t flushSize;
+    std::vector<std::string> chunks;
+    size_t used = 0; // chunks in use, the rest keep their capacity for later
+    size_t bytes = 0;
+};
+
+#endif
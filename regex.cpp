@@ -0,0 +1,739 @@
+#include "regex.hpp"
+
+#include "match.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+using CharacterSet = std::array<uint64_t, 4>;
+
+// limits keeping a hostile pattern from eating all memory
+constexpr size_t maximumNfaStates = 10000;
+constexpr int maximumRepeat = 1000;
+// states of one thread's DFA before the cache is dropped and built again
+constexpr size_t maximumDfaStates = 4096;
+
+std::atomic<uint64_t> nextPatternId{1};
+
+void addCharacter(CharacterSet& set, unsigned char c) {
+    set[c >> 6] |= uint64_t(1) << (c & 63);
+}
+
+bool hasCharacter(const CharacterSet& set, unsigned char c) {
+    return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+void addRange(CharacterSet& set, unsigned char first, unsigned char last) {
+    for (unsigned c = first; c <= last; ++c) {
+        addCharacter(set, static_cast<unsigned char>(c));
+    }
+}
+
+// syntax tree of the expression
+struct Node {
+    enum Kind { Set, Empty, Concat, Alternate, Star, Plus, Optional, Begin, End } kind;
+    CharacterSet set{};
+    std::vector<std::unique_ptr<Node>> children;
+
+    explicit Node(Kind kind) : kind(kind) {}
+
+    std::unique_ptr<Node> clone() const {
+        auto copy = std::make_unique<Node>(kind);
+        copy->set = set;
+        for (const auto& child : children) {
+            copy->children.push_back(child->clone());
+        }
+        return copy;
+    }
+
+    // nodes in this subtree, every one becomes at most one NFA state
+    size_t size() const {
+        size_t count = 1;
+        for (const auto& child : children) {
+            count += child->size();
+        }
+        return count;
+    }
+};
+
+class Parser {
+public:
+    Parser(std::string_view expression, bool ignoreCase) : expression(expression), ignoreCase(ignoreCase) {}
+
+    std::unique_ptr<Node> parse() {
+        auto node = alternation();
+        if (position < expression.size()) {
+            fail("unmatched )");
+        }
+        return node;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::invalid_argument("invalid regex \"" + std::string(expression) + "\": " + message);
+    }
+
+    bool atEnd() const { return position >= expression.size(); }
+    char peek() const { return expression[position]; }
+
+    std::unique_ptr<Node> alternation() {
+        auto first = concatenation();
+        if (atEnd() || peek() != '|') {
+            return first;
+        }
+        auto node = std::make_unique<Node>(Node::Alternate);
+        node->children.push_back(std::move(first));
+        while (!atEnd() && peek() == '|') {
+            ++position;
+            node->children.push_back(concatenation());
+        }
+        return node;
+    }
+
+    std::unique_ptr<Node> concatenation() {
+        auto node = std::make_unique<Node>(Node::Concat);
+        while (!atEnd() && peek() != '|' && peek() != ')') {
+            node->children.push_back(repetition());
+        }
+        if (node->children.size() == 1) {
+            return std::move(node->children[0]);
+        }
+        if (node->children.empty()) {
+            return std::make_unique<Node>(Node::Empty);
+        }
+        return node;
+    }
+
+    std::unique_ptr<Node> repetition() {
+        auto node = atom();
+        while (!atEnd()) {
+            char c = peek();
+            if (c == '*' || c == '+' || c == '?') {
+                ++position;
+                auto repeated = std::make_unique<Node>(c == '*' ? Node::Star : c == '+' ? Node::Plus : Node::Optional);
+                repeated->children.push_back(std::move(node));
+                node = std::move(repeated);
+            } else if (c == '{' && isCount()) {
+                node = counted(std::move(node));
+            } else {
+                break;
+            }
+        }
+        return node;
+    }
+
+    // '{' followed by m}, m,} or m,n} is a count, otherwise a literal brace
+    bool isCount() const {
+        size_t i = position + 1;
+        size_t digits = 0;
+        while (i < expression.size() && std::isdigit(static_cast<unsigned char>(expression[i]))) {
+            ++i;
+            ++digits;
+        }
+        if (digits == 0) {
+            return false;
+        }
+        if (i < expression.size() && expression[i] == ',') {
+            ++i;
+            while (i < expression.size() && std::isdigit(static_cast<unsigned char>(expression[i]))) {
+                ++i;
+            }
+        }
+        return i < expression.size() && expression[i] == '}';
+    }
+
+    int number() {
+        int value = 0;
+        while (!atEnd() && std::isdigit(static_cast<unsigned char>(peek()))) {
+            value = value * 10 + (peek() - '0');
+            if (value > maximumRepeat) {
+                fail("repeat count larger than " + std::to_string(maximumRepeat));
+            }
+            ++position;
+        }
+        return value;
+    }
+
+    // x{m,n}: m copies of x followed by n - m optional ones, or by x* without an upper bound
+    std::unique_ptr<Node> counted(std::unique_ptr<Node> node) {
+        ++position; // {
+        int minimum = number();
+        int maximum = minimum;
+        bool unbounded = false;
+        if (peek() == ',') {
+            ++position;
+            if (peek() == '}') {
+                unbounded = true;
+            } else {
+                maximum = number();
+            }
+        }
+        ++position; // }
+        if (!unbounded && maximum < minimum) {
+            fail("bad repeat count");
+        }
+        // checked before cloning: nested counts multiply, (a{1000}){1000} would build
+        // a million nodes before build() could reject the NFA
+        const size_t copies = unbounded ? minimum + 1 : maximum;
+        clonedNodes += node->size() * copies + (maximum - minimum);
+        if (clonedNodes > maximumNfaStates) {
+            fail("expression too large");
+        }
+
+        auto sequence = std::make_unique<Node>(Node::Concat);
+        for (int i = 0; i < minimum; ++i) {
+            sequence->children.push_back(node->clone());
+        }
+        if (unbounded) {
+            auto star = std::make_unique<Node>(Node::Star);
+            star->children.push_back(node->clone());
+            sequence->children.push_back(std::move(star));
+        } else {
+            for (int i = minimum; i < maximum; ++i) {
+                auto optional = std::make_unique<Node>(Node::Optional);
+                optional->children.push_back(node->clone());
+                sequence->children.push_back(std::move(optional));
+            }
+        }
+        return sequence;
+    }
+
+    std::unique_ptr<Node> atom() {
+        char c = peek();
+        ++position;
+        switch (c) {
+        case '(': {
+            auto node = alternation();
+            if (atEnd() || peek() != ')') {
+                fail("unmatched (");
+            }
+            ++position;
+            return node;
+        }
+        case '*':
+        case '+':
+        case '?':
+            fail(std::string("nothing to repeat before ") + c);
+        case '^':
+            return std::make_unique<Node>(Node::Begin);
+        case '$':
+            return std::make_unique<Node>(Node::End);
+        case '.': {
+            auto node = std::make_unique<Node>(Node::Set);
+            node->set = {~uint64_t(0), ~uint64_t(0), ~uint64_t(0), ~uint64_t(0)};
+            return node;
+        }
+        case '[':
+            return bracket();
+        case '\\': {
+            if (atEnd()) {
+                fail("trailing backslash");
+            }
+            auto node = std::make_unique<Node>(Node::Set);
+            escape(peek(), node->set);
+            ++position;
+            foldSet(node->set);
+            return node;
+        }
+        default: {
+            auto node = std::make_unique<Node>(Node::Set);
+            addCharacter(node->set, static_cast<unsigned char>(c));
+            foldSet(node->set);
+            return node;
+        }
+        }
+    }
+
+    // \d \w \s and their negations, anything else stands for itself
+    static void escape(char c, CharacterSet& set) {
+        switch (c) {
+        case 'd':
+        case 'D':
+            addRange(set, '0', '9');
+            break;
+        case 'w':
+        case 'W':
+            addRange(set, '0', '9');
+            addRange(set, 'a', 'z');
+            addRange(set, 'A', 'Z');
+            addCharacter(set, '_');
+            break;
+        case 's':
+        case 'S':
+            for (char space : std::string_view(" \t\n\r\f\v")) {
+                addCharacter(set, static_cast<unsigned char>(space));
+            }
+            break;
+        default:
+            addCharacter(set, static_cast<unsigned char>(c));
+            return;
+        }
+        if (c == 'D' || c == 'W' || c == 'S') {
+            for (auto& word : set) {
+                word = ~word;
+            }
+        }
+    }
+
+    std::unique_ptr<Node> bracket() {
+        auto node = std::make_unique<Node>(Node::Set);
+        bool negated = false;
+        if (!atEnd() && peek() == '^') {
+            negated = true;
+            ++position;
+        }
+        bool first = true;
+        while (true) {
+            if (atEnd()) {
+                fail("unmatched [");
+            }
+            char c = peek();
+            if (c == ']' && !first) {
+                ++position;
+                break;
+            }
+            first = false;
+            ++position;
+            if (c == '\\' && !atEnd()) {
+                escape(peek(), node->set);
+                ++position;
+                continue;
+            }
+            if (position + 1 < expression.size() && peek() == '-' && expression[position + 1] != ']') {
+                char last = expression[position + 1];
+                position += 2;
+                if (static_cast<unsigned char>(last) < static_cast<unsigned char>(c)) {
+                    fail("bad range in []");
+                }
+                addRange(node->set, static_cast<unsigned char>(c), static_cast<unsigned char>(last));
+            } else {
+                addCharacter(node->set, static_cast<unsigned char>(c));
+            }
+        }
+        // fold before negating, so [^a] with -i excludes both cases
+        foldSet(node->set);
+        if (negated) {
+            for (auto& word : node->set) {
+                word = ~word;
+            }
+        }
+        return node;
+    }
+
+    void foldSet(CharacterSet& set) const {
+        if (!ignoreCase) {
+            return;
+        }
+        for (unsigned c = 'a'; c <= 'z'; ++c) {
+            unsigned upper = c - 'a' + 'A';
+            if (hasCharacter(set, static_cast<unsigned char>(c)) || hasCharacter(set, static_cast<unsigned char>(upper))) {
+                addCharacter(set, static_cast<unsigned char>(c));
+                addCharacter(set, static_cast<unsigned char>(upper));
+            }
+        }
+    }
+
+    std::string_view expression;
+    bool ignoreCase;
+    size_t clonedNodes = 0; // nodes created by counted repeats so far, against maximumNfaStates
+    size_t position = 0;
+};
+
+// the single byte a set stands for (lowercase with -i), or -1
+int literalByte(const Node& node, bool ignoreCase) {
+    if (node.kind != Node::Set) {
+        return -1;
+    }
+    int count = 0;
+    int byte = -1;
+    for (unsigned c = 0; c < 256; ++c) {
+        if (hasCharacter(node.set, static_cast<unsigned char>(c))) {
+            ++count;
+            if (byte < 0 || (c >= 'a' && c <= 'z')) {
+                byte = static_cast<int>(c);
+            }
+        }
+    }
+    bool casePair = ignoreCase && count == 2 && byte >= 'a' && byte <= 'z';
+    return (count == 1 || casePair) ? byte : -1;
+}
+
+// longest string every match of node has to contain
+std::string longestLiteral(const Node& node, bool ignoreCase) {
+    switch (node.kind) {
+    case Node::Set: {
+        int byte = literalByte(node, ignoreCase);
+        return byte < 0 ? std::string() : std::string(1, static_cast<char>(byte));
+    }
+    case Node::Plus:
+        return longestLiteral(*node.children[0], ignoreCase);
+    case Node::Concat: {
+        std::string best;
+        std::string run;
+        for (const auto& child : node.children) {
+            int byte = literalByte(*child, ignoreCase);
+            if (byte >= 0) {
+                run += static_cast<char>(byte);
+                continue;
+            }
+            // anchors take no room, the run around them stays contiguous
+            if (child->kind == Node::Begin || child->kind == Node::End) {
+                continue;
+            }
+            if (run.size() > best.size()) {
+                best = run;
+            }
+            run.clear();
+            std::string inner = longestLiteral(*child, ignoreCase);
+            if (inner.size() > best.size()) {
+                best = inner;
+            }
+        }
+        return run.size() > best.size() ? run : best;
+    }
+    default:
+        return std::string();
+    }
+}
+
+} // namespace
+
+struct RegexPattern::NfaState {
+    enum Kind { Byte, Split, Begin, End, Match } kind;
+    CharacterSet set{}; // Byte: accepted bytes
+    int next = -1;
+    int alternative = -1; // Split: second successor
+};
+
+// one thread's lazily built DFA. Each state is the epsilon closure of a set of NFA states,
+// transitions are filled in the first time they are taken
+struct RegexPattern::Dfa {
+    struct State {
+        std::vector<int> nfaStates; // sorted, as key of known
+        bool matched = false;       // contains the match state: the name matches
+        int8_t endMatched = -1;     // match once the name ends here, -1 not computed yet
+        std::array<int32_t, 256> next;
+    };
+
+    uint64_t patternId = 0;
+    std::vector<State> states;
+    std::map<std::vector<int>, int32_t> known;
+    RegexStatistics statistics;
+
+    // scratch space for closures
+    std::vector<int> stack;
+    std::vector<uint32_t> seen;
+    uint32_t generation = 0;
+};
+
+namespace {
+
+// add the epsilon closure of state to out, following ^ only at the start of the name
+// and $ only at its end
+void closure(const std::vector<RegexPattern::NfaState>& nfa, RegexPattern::Dfa& dfa, int state, bool atStart,
+             bool atEnd, std::vector<int>& out) {
+    using NfaState = RegexPattern::NfaState;
+    dfa.stack.push_back(state);
+    while (!dfa.stack.empty()) {
+        int s = dfa.stack.back();
+        dfa.stack.pop_back();
+        if (dfa.seen[s] == dfa.generation) {
+            continue;
+        }
+        dfa.seen[s] = dfa.generation;
+        const NfaState& current = nfa[s];
+        switch (current.kind) {
+        case NfaState::Byte:
+        case NfaState::Match:
+            out.push_back(s);
+            break;
+        case NfaState::Split:
+            dfa.stack.push_back(current.alternative);
+            dfa.stack.push_back(current.next);
+            break;
+        case NfaState::Begin:
+            if (atStart) {
+                dfa.stack.push_back(current.next);
+            }
+            break;
+        case NfaState::End:
+            if (atEnd) {
+                dfa.stack.push_back(current.next);
+            } else {
+                out.push_back(s); // kept for the check at the end of the name
+            }
+            break;
+        }
+    }
+}
+
+void newGeneration(RegexPattern::Dfa& dfa, size_t nfaSize) {
+    if (dfa.seen.size() != nfaSize || ++dfa.generation == 0) {
+        dfa.seen.assign(nfaSize, 0);
+        dfa.generation = 1;
+    }
+}
+
+// Thompson construction back to front: returns the first state of node, continuing at next
+int build(const Node& node, int next, std::vector<RegexPattern::NfaState>& nfa) {
+    using NfaState = RegexPattern::NfaState;
+    auto add = [&](NfaState state) {
+        if (nfa.size() >= maximumNfaStates) {
+            throw std::invalid_argument("invalid regex: expression too large");
+        }
+        nfa.push_back(state);
+        return static_cast<int>(nfa.size() - 1);
+    };
+
+    switch (node.kind) {
+    case Node::Set: {
+        NfaState state{NfaState::Byte};
+        state.set = node.set;
+        state.next = next;
+        return add(state);
+    }
+    case Node::Empty:
+        return next;
+    case Node::Concat:
+        for (auto child = node.children.rbegin(); child != node.children.rend(); ++child) {
+            next = build(**child, next, nfa);
+        }
+        return next;
+    case Node::Alternate: {
+        int first = build(*node.children.back(), next, nfa);
+        for (size_t i = node.children.size() - 1; i-- > 0;) {
+            NfaState split{NfaState::Split};
+            split.next = build(*node.children[i], next, nfa);
+            split.alternative = first;
+            first = add(split);
+        }
+        return first;
+    }
+    case Node::Star:
+    case Node::Plus: {
+        int loop = add(NfaState{NfaState::Split});
+        int body = build(*node.children[0], loop, nfa);
+        nfa[loop].next = body;
+        nfa[loop].alternative = next;
+        return node.kind == Node::Star ? loop : body;
+    }
+    case Node::Optional: {
+        NfaState split{NfaState::Split};
+        split.next = build(*node.children[0], next, nfa);
+        split.alternative = next;
+        return add(split);
+    }
+    case Node::Begin:
+    case Node::End: {
+        NfaState state{node.kind == Node::Begin ? NfaState::Begin : NfaState::End};
+        state.next = next;
+        return add(state);
+    }
+    }
+    return next;
+}
+
+// index of the DFA state for the sorted NFA state set, built if it is new
+int32_t dfaState(const std::vector<RegexPattern::NfaState>& nfa, RegexPattern::Dfa& dfa, std::vector<int>& nfaStates) {
+    std::sort(nfaStates.begin(), nfaStates.end());
+    auto found = dfa.known.find(nfaStates);
+    if (found != dfa.known.end()) {
+        return found->second;
+    }
+    RegexPattern::Dfa::State state;
+    state.nfaStates = nfaStates;
+    for (int s : nfaStates) {
+        if (nfa[s].kind == RegexPattern::NfaState::Match) {
+            state.matched = true;
+        }
+    }
+    state.next.fill(-1);
+    int32_t index = static_cast<int32_t>(dfa.states.size());
+    dfa.states.push_back(std::move(state));
+    dfa.known.emplace(nfaStates, index);
+    ++dfa.statistics.dfaStates;
+    return index;
+}
+
+} // namespace
+
+RegexPattern::RegexPattern(std::string_view expression, bool ignoreCase)
+    : ignoreCase(ignoreCase), id(nextPatternId.fetch_add(1)) {
+    auto begin = std::chrono::steady_clock::now();
+
+    std::unique_ptr<Node> tree = Parser(expression, ignoreCase).parse();
+    nfa.push_back(NfaState{NfaState::Match});
+    start = build(*tree, 0, nfa);
+    literal = longestLiteral(*tree, ignoreCase);
+
+    compileTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+RegexPattern::~RegexPattern() = default;
+
+RegexPattern::Dfa& RegexPattern::threadDfa() const {
+    // last pattern this thread used, so the common single-pattern case skips the lookup;
+    // ids are never reused, so a destroyed pattern's id never matches again
+    thread_local uint64_t lastId = 0;
+    thread_local Dfa* last = nullptr;
+    // the pattern owns the Dfa, the thread only watches it: entries of destroyed patterns
+    // expire and are dropped on the next miss, so the list holds live patterns only
+    thread_local std::vector<std::pair<uint64_t, std::weak_ptr<Dfa>>> perPattern;
+    if (lastId == id) {
+        return *last;
+    }
+    perPattern.erase(std::remove_if(perPattern.begin(), perPattern.end(),
+                                    [](const auto& entry) { return entry.second.expired(); }),
+                     perPattern.end());
+    for (const auto& entry : perPattern) {
+        if (entry.first == id) {
+            lastId = id;
+            last = entry.second.lock().get();
+            return *last;
+        }
+    }
+
+    auto dfa = std::make_shared<Dfa>();
+    dfa->patternId = id;
+    lastId = id;
+    last = dfa.get();
+    perPattern.emplace_back(id, dfa);
+    std::lock_guard<std::mutex> guard(dfaLock);
+    dfas.push_back(std::move(dfa));
+    return *last;
+}
+
+bool RegexPattern::containsLiteral(std::string_view name) const {
+    if (literal.empty()) {
+        return true;
+    }
+    if (name.size() < literal.size()) {
+        return false;
+    }
+    // scan for the first byte (either case with -i), then compare the rest; on names this
+    // short that beats memmem, which spends more on setup than on the search
+    const char first = literal[0];
+    const char upper = ignoreCase && first >= 'a' && first <= 'z' ? static_cast<char>(first - 'a' + 'A') : first;
+    const size_t last = name.size() - literal.size();
+    for (size_t i = 0; i <= last; ++i) {
+        const void* lower = memchr(name.data() + i, first, last - i + 1);
+        const void* other = upper == first ? nullptr : memchr(name.data() + i, upper, last - i + 1);
+        const char* candidate = static_cast<const char*>(lower);
+        if (other != nullptr && (candidate == nullptr || other < lower)) {
+            candidate = static_cast<const char*>(other);
+        }
+        if (candidate == nullptr) {
+            return false;
+        }
+        i = static_cast<size_t>(candidate - name.data());
+        std::string_view rest = name.substr(i + 1, literal.size() - 1);
+        if (ignoreCase ? equalsFolded(rest, std::string_view(literal).substr(1))
+                       : memcmp(rest.data(), literal.data() + 1, rest.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RegexPattern::run(Dfa& dfa, std::string_view name) const {
+    std::vector<int> nfaStates;
+    if (dfa.states.empty() || dfa.states.size() > maximumDfaStates) {
+        if (!dfa.states.empty()) {
+            ++dfa.statistics.dfaFlushes;
+        }
+        dfa.states.clear();
+        dfa.known.clear();
+        newGeneration(dfa, nfa.size());
+        closure(nfa, dfa, start, true, false, nfaStates);
+        dfaState(nfa, dfa, nfaStates); // state 0: start of every name
+    }
+
+    int32_t state = 0;
+    for (unsigned char c : name) {
+        if (dfa.states[state].matched) {
+            return true;
+        }
+        int32_t next = dfa.states[state].next[c];
+        if (next < 0) {
+            // the pattern may begin at every position, so the start is part of every state
+            nfaStates.clear();
+            newGeneration(dfa, nfa.size());
+            for (int s : dfa.states[state].nfaStates) {
+                if (nfa[s].kind == NfaState::Byte && hasCharacter(nfa[s].set, c)) {
+                    closure(nfa, dfa, nfa[s].next, false, false, nfaStates);
+                }
+            }
+            closure(nfa, dfa, start, false, false, nfaStates);
+            next = dfaState(nfa, dfa, nfaStates);
+            dfa.states[state].next[c] = next;
+        }
+        state = next;
+    }
+
+    Dfa::State& final = dfa.states[state];
+    if (final.endMatched < 0) {
+        nfaStates.clear();
+        newGeneration(dfa, nfa.size());
+        final.endMatched = 0;
+        for (int s : final.nfaStates) {
+            closure(nfa, dfa, s, false, true, nfaStates);
+        }
+        for (int s : nfaStates) {
+            if (nfa[s].kind == NfaState::Match) {
+                final.endMatched = 1;
+            }
+        }
+    }
+    return final.matched || final.endMatched == 1;
+}
+
+bool RegexPattern::matches(std::string_view name) const {
+    Dfa& dfa = threadDfa();
+    RegexStatistics& statistics = dfa.statistics;
+    const bool sampled = timed && (statistics.names & 63) == 0;
+    ++statistics.names;
+    statistics.bytes += name.size();
+
+    std::chrono::steady_clock::time_point begin;
+    if (sampled) {
+        begin = std::chrono::steady_clock::now();
+    }
+    bool matched = false;
+    if (!containsLiteral(name)) {
+        ++statistics.prefilterRejects;
+    } else {
+        matched = run(dfa, name);
+    }
+    if (sampled) {
+        statistics.nanoseconds += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+        ++statistics.timedNames;
+        statistics.timedBytes += name.size();
+    }
+    statistics.matches += matched;
+    return matched;
+}
+
+RegexStatistics RegexPattern::statistics() const {
+    RegexStatistics total;
+    std::lock_guard<std::mutex> guard(dfaLock);
+    for (const auto& dfa : dfas) {
+        total.names += dfa->statistics.names;
+        total.bytes += dfa->statistics.bytes;
+        total.prefilterRejects += dfa->statistics.prefilterRejects;
+        total.matches += dfa->statistics.matches;
+        total.timedNames += dfa->statistics.timedNames;
+        total.timedBytes += dfa->statistics.timedBytes;
+        total.nanoseconds += dfa->statistics.nanoseconds;
+        total.dfaStates += dfa->statistics.dfaStates;
+        total.dfaFlushes += dfa->statistics.dfaFlushes;
+    }
+    return total;
+}
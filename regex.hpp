@@ -0,0 +1,69 @@
+#ifndef MYFIND_REGEX_HPP
+#define MYFIND_REGEX_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// counters of one thread's matching, summed up for --stats
+struct RegexStatistics {
+    uint64_t names = 0;            // names tested
+    uint64_t bytes = 0;            // bytes of those names
+    uint64_t prefilterRejects = 0; // names without the required literal
+    uint64_t matches = 0;
+    // with --stats every 64th name is timed, the clock costs about as much as a match
+    uint64_t timedNames = 0;
+    uint64_t timedBytes = 0;
+    uint64_t nanoseconds = 0;      // spent matching the timed names
+    uint64_t dfaStates = 0;        // built so far
+    uint64_t dfaFlushes = 0;       // times the state cache was full and dropped
+};
+
+// extended regular expression matched against filenames, found anywhere in the name unless
+// anchored with ^ / $. Supports . [...] [^...] * + ? {m,n} | ( ) and \d \w \s escapes.
+// Compiled once into a Thompson NFA; matching runs a DFA that is built lazily, one state per
+// new set of NFA states, with a separate state cache per thread. A literal every match must
+// contain is searched for first, so most names never reach the automaton.
+// errors in the expression are reported as std::invalid_argument
+class RegexPattern {
+public:
+    RegexPattern(std::string_view expression, bool ignoreCase);
+    ~RegexPattern();
+    RegexPattern(const RegexPattern&) = delete;
+    RegexPattern& operator=(const RegexPattern&) = delete;
+
+    bool matches(std::string_view name) const;
+
+    // sample the time spent matching, for --stats
+    void measureTime(bool enabled) { timed = enabled; }
+    double compileMilliseconds() const { return compileTime; }
+    const std::string& requiredLiteral() const { return literal; }
+    // sum over all threads, call once no thread is matching anymore
+    RegexStatistics statistics() const;
+
+    struct NfaState;
+    struct Dfa;
+
+private:
+    Dfa& threadDfa() const;
+    bool run(Dfa& dfa, std::string_view name) const;
+    bool containsLiteral(std::string_view name) const;
+
+    bool ignoreCase;
+    bool timed = false;
+    double compileTime = 0;
+    std::string literal; // case-folded with -i
+    std::vector<NfaState> nfa;
+    int start = 0;
+    uint64_t id; // tells thread-local caches of different patterns apart
+
+    mutable std::mutex dfaLock; // guards dfas, each Dfa is only used by its own thread
+    mutable std::vector<std::shared_ptr<Dfa>> dfas; // threads keep weak_ptrs to theirs
+};
+
+#endif
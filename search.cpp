@@ -0,0 +1,410 @@
+#include "search.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <numeric>
+#include <sys/stat.h>
+
+#include "daemon.hpp"
+#include "ignore.hpp"
+#include "index.hpp"
+
+namespace {
+
+// a batch of the iterator is handed over once it holds this many paths or bytes
+constexpr size_t batchEntries = 256;
+constexpr size_t batchBytes = 64 * 1024;
+
+} // namespace
+
+std::string_view SearchResult::path() const {
+    if (joinedPath.empty()) {
+        // a result that did not come from a search joins into a buffer of its own
+        std::string& buffer = pathBuffer != nullptr ? *pathBuffer : ownedPath;
+        buffer.assign(directory);
+        if (!name.empty()) {
+            if (directory.empty() || directory.back() != '/') {
+                buffer += '/';
+            }
+            buffer.append(name);
+        }
+        joinedPath = buffer;
+    }
+    return joinedPath;
+}
+
+Searcher::Searcher(SearchOptions options)
+    : settings(std::move(options)),
+      matcher(settings.filenames, settings.ignoreCase, settings.matchMode),
+      prune(settings.prunePatterns, settings.ignoreCase) {
+    matcher.measureTime(settings.measureTime);
+    for (const auto& predicate : settings.metadataPredicates) {
+        filter.add(predicate.first, predicate.second);
+    }
+    filter.setFollowSymlinks(settings.followSymlinks);
+    // a depth limit only makes sense for a recursive search
+    if (settings.maxDepth > 0) {
+        settings.recursive = true;
+    }
+}
+
+SearchSummary Searcher::run(const SearchCallback& onResult, const SearchErrorHandler& onError) {
+    SearchSummary summary;
+    summary.hits.assign(settings.filenames.size(), 0);
+    if (!settings.indexFile.empty()) {
+        summary.source = SearchSource::Index;
+        searchIndex(onResult, summary);
+    } else if (!askDaemon(onResult, summary)) {
+        summary.source = SearchSource::Walk;
+        walk(onResult, onError, summary);
+    }
+    return summary;
+}
+
+void Searcher::cancel() {
+    cancelled.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(walkerLock);
+    if (walker != nullptr) {
+        walker->cancel();
+    }
+}
+
+// one traversal of root for all filenames, split between the walker threads
+void Searcher::walk(const SearchCallback& onResult, const SearchErrorHandler& onError, SearchSummary& summary) {
+    const unsigned threads = std::max(1u, settings.threads);
+    // every path is built by appending to the absolute root, no fs::absolute per match;
+    // normalized, so entry paths and the ignore frames of its parents spell it the same
+    summary.root = normalizeRoot(settings.root);
+    const std::string& root = summary.root;
+    const size_t patterns = settings.filenames.size();
+
+    std::vector<std::vector<size_t>> hits(threads, std::vector<size_t>(patterns, 0));
+    std::vector<std::string> pathBuffers(threads);
+    std::vector<uint64_t> filterLookups(threads, 0); // statx calls of the metadata filter
+    // hitLimit: hits shared by all workers, the walk is cancelled once every name has enough
+    std::vector<std::atomic<size_t>> limitedHits(settings.hitLimit > 0 ? patterns : 0);
+    std::atomic<size_t> satisfied{0};
+    ParallelWalker* running = nullptr;
+
+    auto report = [&](unsigned worker, const std::string& parent, const WalkEntry& entry) {
+        int passed = -1; // metadata filter result, looked up on the first match only
+        matcher.forEachMatch(entry.name, [&](size_t index) {
+            if (passed < 0) {
+                passed = filter.empty()
+                         || filter.matches(entry.directoryFd, parent, entry.name, entry.type, filterLookups[worker]);
+            }
+            if (!passed) {
+                return;
+            }
+            if (settings.hitLimit > 0) {
+                size_t hit = limitedHits[index].fetch_add(1, std::memory_order_relaxed);
+                if (hit >= settings.hitLimit) {
+                    return; // another worker got there first
+                }
+                if (hit + 1 == settings.hitLimit && satisfied.fetch_add(1, std::memory_order_relaxed) + 1 == patterns) {
+                    running->cancel();
+                }
+            }
+            SearchResult result;
+            result.pattern = index;
+            result.directory = parent;
+            result.name = entry.name;
+            result.isDirectory = entry.isDirectory;
+            result.worker = worker;
+            result.pathBuffer = &pathBuffers[worker];
+            onResult(result);
+            ++hits[worker][index];
+        });
+    };
+    auto reportError = [&](const std::string& parent, const std::string& message) {
+        if (onError) {
+            onError(parent, message);
+        }
+    };
+
+    ParallelWalker parallelWalker(threads, settings.recursive, settings.backend, report, reportError);
+    running = &parallelWalker;
+    parallelWalker.setTrace(settings.trace);
+    parallelWalker.setOrder(settings.order);
+    parallelWalker.setUringDepth(settings.uringDepth);
+    parallelWalker.setDepthLimits(settings.minDepth, settings.maxDepth);
+    parallelWalker.setFollowSymlinks(settings.followSymlinks);
+    parallelWalker.setSameDevice(settings.sameDevice);
+    parallelWalker.setDeviceLimit(settings.deviceJobs);
+    for (const auto& limit : settings.deviceJobsFor) {
+        struct stat status;
+        if (stat(limit.first.c_str(), &status) == 0) {
+            parallelWalker.setDeviceLimit(status.st_dev, limit.second);
+        } else {
+            reportError(limit.first, strerror(errno));
+        }
+    }
+    if (settings.respectIgnore) {
+        parallelWalker.setIgnoreRules(IgnoreFrame::forRoot(root));
+    }
+    if (!prune.empty()) {
+        parallelWalker.setPruneFilter([&](const std::string& path, std::string_view name) {
+            return prune.matches(path, name);
+        });
+    }
+    {
+        std::lock_guard<std::mutex> guard(walkerLock);
+        walker = &parallelWalker;
+        if (cancelled.load(std::memory_order_relaxed)) {
+            parallelWalker.cancel();
+        }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    parallelWalker.run(root);
+    summary.statistics.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    {
+        std::lock_guard<std::mutex> guard(walkerLock);
+        walker = nullptr;
+    }
+
+    summary.statistics.workers = parallelWalker.statistics();
+    for (unsigned i = 0; i < threads; ++i) {
+        summary.statistics.workers[i].statCalls += filterLookups[i];
+        uint64_t matches = 0;
+        for (size_t index = 0; index < patterns; ++index) {
+            summary.hits[index] += hits[i][index];
+            matches += hits[i][index];
+        }
+        summary.statistics.matches.push_back(matches);
+    }
+}
+
+// all filenames looked up in the index, only entries below root are reported
+void Searcher::searchIndex(const SearchCallback& onResult, SearchSummary& summary) {
+    auto start = std::chrono::steady_clock::now();
+    IndexReader index(settings.indexFile);
+    summary.root = normalizeRoot(settings.root);
+    const std::string& base = summary.root;
+    const std::string& indexRoot = index.root();
+
+    // entries are stored relative to the index root, so the search path becomes a prefix
+    std::string prefix;
+    if (base != indexRoot) {
+        std::string rootPrefix = indexRoot == "/" ? indexRoot : indexRoot + "/";
+        if (base.compare(0, rootPrefix.size(), rootPrefix) != 0) {
+            throw std::runtime_error(settings.root + " is not covered by the index of " + indexRoot);
+        }
+        prefix = base.substr(rootPrefix.size()) + "/";
+    }
+
+    const size_t hitLimit = settings.hitLimit;
+    std::vector<size_t>& hits = summary.hits;
+    std::string pathBuffer;
+    std::string directoryPath;
+
+    // path relative to root if the entry is one the search covers;
+    // the walk never opens pruned directories, here their entries are skipped instead
+    auto below = [&](std::string_view path, std::string_view& remainder) {
+        if (path.compare(0, prefix.size(), prefix) != 0) {
+            return false;
+        }
+        remainder = path.substr(prefix.size());
+        if (!settings.recursive && remainder.find('/') != std::string_view::npos) {
+            return false;
+        }
+        if (settings.minDepth == 0 && settings.maxDepth == 0 && prune.empty()) {
+            return true;
+        }
+        int depth = 1 + static_cast<int>(std::count(remainder.begin(), remainder.end(), '/'));
+        if (depth < settings.minDepth || (settings.maxDepth > 0 && depth > settings.maxDepth)) {
+            return false;
+        }
+        // every directory above the entry, closest to the search path first
+        size_t start = 0;
+        for (size_t slash = remainder.find('/'); slash != std::string_view::npos && !prune.empty();
+             slash = remainder.find('/', start)) {
+            directoryPath.assign(base == "/" ? "" : base).append("/").append(remainder.substr(0, slash));
+            if (prune.matches(directoryPath, remainder.substr(start, slash - start))) {
+                return false;
+            }
+            start = slash + 1;
+        }
+        return true;
+    };
+
+    // the index has no metadata, entries that matched are looked up by path
+    uint64_t lookups = 0;
+    auto filtered = [&](std::string_view remainder, bool isDirectory) {
+        return filter.empty() || filter.matches(-1, base, remainder, isDirectory ? DT_DIR : DT_UNKNOWN, lookups);
+    };
+    auto reportMatch = [&](size_t pattern, std::string_view remainder, bool isDirectory) {
+        SearchResult result;
+        result.pattern = pattern;
+        result.directory = base;
+        result.name = remainder;
+        result.isDirectory = isDirectory;
+        result.pathBuffer = &pathBuffer;
+        onResult(result);
+        ++hits[pattern];
+    };
+
+    if (!matcher.plainNamesOnly()) {
+        // the name table only helps plain names, other patterns need one pass over all entries
+        index.forEachEntry([&](uint64_t, std::string_view path, bool isDirectory) {
+            std::string_view remainder;
+            if (cancelled.load(std::memory_order_relaxed) || !below(path, remainder)) {
+                return;
+            }
+            size_t slash = remainder.rfind('/');
+            int passed = -1;
+            matcher.forEachMatch(slash == std::string_view::npos ? remainder : remainder.substr(slash + 1), [&](size_t i) {
+                if (hitLimit > 0 && hits[i] >= hitLimit) {
+                    return;
+                }
+                if (passed < 0) {
+                    passed = filtered(remainder, isDirectory);
+                }
+                if (passed) {
+                    reportMatch(i, remainder, isDirectory);
+                }
+            });
+        });
+    } else {
+        for (size_t i = 0; i < settings.filenames.size() && !cancelled.load(std::memory_order_relaxed); ++i) {
+            index.findName(GlobPattern::unescape(settings.filenames[i]), settings.ignoreCase,
+                           [&](std::string_view path, bool isDirectory) {
+                std::string_view remainder;
+                if (below(path, remainder) && (hitLimit == 0 || hits[i] < hitLimit) && filtered(remainder, isDirectory)) {
+                    reportMatch(i, remainder, isDirectory);
+                }
+            });
+        }
+    }
+    summary.statistics.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    summary.statistics.matches.assign(1, std::accumulate(hits.begin(), hits.end(), uint64_t(0)));
+}
+
+bool Searcher::askDaemon(const SearchCallback& onResult, SearchSummary& summary) {
+    // the daemon only looks up plain names and knows nothing of depths, pruning, ignore files,
+    // symlinks, devices and metadata
+    if (settings.daemonSocket.empty() || !matcher.plainNamesOnly() || settings.minDepth > 0 || settings.maxDepth > 0
+        || !prune.empty() || settings.respectIgnore || settings.followSymlinks || settings.sameDevice || !filter.empty()) {
+        return false;
+    }
+    std::vector<std::string> plainNames;
+    for (const auto& filename : settings.filenames) {
+        plainNames.push_back(GlobPattern::unescape(filename));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    summary.source = SearchSource::Daemon;
+    summary.root = normalizeRoot(settings.root);
+    summary.hits.assign(settings.filenames.size(), 0);
+    std::string pathBuffer;
+    bool answered = queryDaemon(settings.daemonSocket, settings.root, plainNames, settings.recursive, settings.ignoreCase,
+                       [&](size_t index, std::string_view path) {
+        if (settings.hitLimit > 0 && summary.hits[index] >= settings.hitLimit) {
+            return;
+        }
+        SearchResult result;
+        result.pattern = index;
+        result.directory = summary.root;
+        result.name = path;
+        result.pathBuffer = &pathBuffer;
+        onResult(result);
+        ++summary.hits[index];
+    });
+    if (answered) {
+        summary.statistics.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        summary.statistics.matches.assign(1, std::accumulate(summary.hits.begin(), summary.hits.end(), uint64_t(0)));
+    }
+    return answered;
+}
+
+SearchSummary search(SearchOptions options, const SearchCallback& onResult, const SearchErrorHandler& onError) {
+    Searcher searcher(std::move(options));
+    return searcher.run(onResult, onError);
+}
+
+SearchIterator::SearchIterator(SearchOptions options, SearchErrorHandler onError) : searcher(std::move(options)) {
+    worker = std::thread([this, onError = std::move(onError)] {
+        SearchSummary summary;
+        std::exception_ptr thrown;
+        try {
+            summary = searcher.run([this](const SearchResult& result) { add(result); }, onError);
+        } catch (...) {
+            thrown = std::current_exception();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        finished = std::move(summary);
+        error = thrown;
+        done = true;
+        changed.notify_all();
+    });
+}
+
+SearchIterator::~SearchIterator() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        changed.notify_all();
+    }
+    searcher.cancel();
+    worker.join();
+}
+
+// called by the walker threads, waits while the batch is full and next() did not take it
+void SearchIterator::add(const SearchResult& result) {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] {
+        return stopping || (filling.entries.size() < batchEntries && filling.paths.size() < batchBytes);
+    });
+    if (stopping) {
+        return;
+    }
+    Batch::Entry entry;
+    entry.pattern = result.pattern;
+    entry.offset = filling.paths.size();
+    filling.paths.append(result.directory);
+    entry.directorySize = result.directory.size();
+    if (!result.name.empty() && (result.directory.empty() || result.directory.back() != '/')) {
+        filling.paths += '/';
+    }
+    entry.nameOffset = filling.paths.size();
+    filling.paths.append(result.name);
+    entry.end = filling.paths.size();
+    entry.isDirectory = result.isDirectory;
+    entry.worker = result.worker;
+    filling.entries.push_back(entry);
+    // the reader only needs waking for the first result of an empty batch or a full one
+    if (filling.entries.size() == 1 || filling.entries.size() >= batchEntries || filling.paths.size() >= batchBytes) {
+        changed.notify_all();
+    }
+}
+
+bool SearchIterator::next(SearchResult& result) {
+    if (position == reading.entries.size()) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return done || !filling.entries.empty(); });
+        if (filling.entries.empty()) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return false;
+        }
+        // the old batch keeps its capacity for the search to fill next
+        std::swap(reading, filling);
+        filling.entries.clear();
+        filling.paths.clear();
+        position = 0;
+        changed.notify_all();
+    }
+    const Batch::Entry& entry = reading.entries[position++];
+    std::string_view paths(reading.paths);
+    result = SearchResult();
+    result.pattern = entry.pattern;
+    result.directory = paths.substr(entry.offset, entry.directorySize);
+    result.name = paths.substr(entry.nameOffset, entry.end - entry.nameOffset);
+    result.isDirectory = entry.isDirectory;
+    result.worker = entry.worker;
+    result.joinedPath = paths.substr(entry.offset, entry.end - entry.offset);
+    return true;
+}
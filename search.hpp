@@ -0,0 +1,176 @@
+#ifndef MYFIND_SEARCH_HPP
+#define MYFIND_SEARCH_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "filter.hpp"
+#include "match.hpp"
+#include "stats.hpp"
+#include "walk.hpp"
+
+/*
+ libmyfind: the search behind the myfind command line, for programs that want the matches
+ without parsing its output. A search is described by SearchOptions and run by a Searcher,
+ which reports every match through a callback; SearchIterator runs the same search on a
+ thread of its own and hands the matches out one at a time. Nothing here keeps global state,
+ any number of searches can run at once
+ */
+
+// what to search for and how; every field has the default the command line has
+struct SearchOptions {
+    std::string root;                   // directory to search
+    std::vector<std::string> filenames; // plain names or globs, substrings with Contains, regexes with Regex
+    MatchMode matchMode = MatchMode::Name;
+    bool recursive = false;             // -R
+    bool ignoreCase = false;            // -i
+    unsigned threads = 1;               // -j
+    Backend backend = Backend::Getdents;
+    unsigned uringDepth = 64;           // operations per io_uring submission
+    Order order = Order::DepthFirst;
+    int minDepth = 0;                   // report entries from this depth on (1: entries of root)
+    int maxDepth = 0;                   // do not descend below this depth, 0 for no limit
+    std::vector<std::string> prunePatterns; // directories that are never opened
+    bool followSymlinks = false;        // -L
+    bool sameDevice = false;            // -xdev
+    unsigned deviceJobs = 0;            // workers per device, 0 for no limit
+    std::vector<std::pair<std::string, unsigned>> deviceJobsFor; // for the device of a path
+    bool respectIgnore = false;         // skip what .gitignore / .ignore files exclude
+    size_t hitLimit = 0;                // stop once every filename has this many hits, 0 finds all
+    std::vector<std::pair<std::string, std::string>> metadataPredicates; // ("type", "f"), ("size", "+1M"), ...
+    std::string indexFile;              // answer from this index instead of walking root
+    std::string daemonSocket;           // ask the daemon listening here first, "" to always walk
+    bool measureTime = false;           // time regex matching for the statistics
+    TraceRecorder* trace = nullptr;     // records every directory visit of the walk if set
+};
+
+// one match; the views point into buffers of the search and are only valid until the
+// callback returns, or with SearchIterator until the next call of next()
+struct SearchResult {
+    size_t pattern = 0;         // position of the filename that matched in SearchOptions::filenames
+    std::string_view directory; // absolute
+    std::string_view name;      // relative to directory, with '/' in it for index and daemon answers
+    bool isDirectory = false;   // false also where the type is not known
+    unsigned worker = 0;        // walker thread that found it, 0 for index and daemon answers
+
+    // directory + '/' + name, joined on first use in a buffer of the worker; a result
+    // filled in by hand joins into a buffer of its own, the view then lives as long as it
+    std::string_view path() const;
+
+private:
+    friend class Searcher;
+    friend class SearchIterator;
+    std::string* pathBuffer = nullptr;
+    mutable std::string ownedPath;
+    mutable std::string_view joinedPath;
+};
+
+// what a search did, once it is over
+struct SearchSummary {
+    SearchSource source = SearchSource::Walk; // see stats.hpp
+    std::string root;             // absolute search path the results are relative to
+    std::vector<size_t> hits;     // reported matches per filename
+    SearchStatistics statistics;  // wall time and matches, walk counters only if the tree was walked
+};
+
+// called for every match; during a walk from all walker threads at once, result.worker
+// tells them apart so per-worker state needs no lock
+using SearchCallback = std::function<void(const SearchResult& result)>;
+// a directory or file that could not be read
+using SearchErrorHandler = std::function<void(const std::string& path, const std::string& message)>;
+
+class Searcher {
+public:
+    // compiles the filenames, pruning rules and metadata predicates once; throws
+    // std::invalid_argument if one of them is not valid
+    explicit Searcher(SearchOptions options);
+    Searcher(const Searcher&) = delete;
+    Searcher& operator=(const Searcher&) = delete;
+
+    const SearchOptions& options() const { return settings; }
+    const NameMatcher& names() const { return matcher; }
+
+    // search and return once every match was reported or the search was cancelled;
+    // throws std::runtime_error if the index cannot be read
+    SearchSummary run(const SearchCallback& onResult, const SearchErrorHandler& onError = nullptr);
+    // only ask the daemon listening on options().daemonSocket; false if there is none or
+    // it cannot answer the search, nothing was reported then
+    bool askDaemon(const SearchCallback& onResult, SearchSummary& summary);
+    // stop the search from any thread, the matches reported so far stand; a search
+    // started after this returns right away
+    void cancel();
+
+private:
+    void searchIndex(const SearchCallback& onResult, SearchSummary& summary);
+    void walk(const SearchCallback& onResult, const SearchErrorHandler& onError, SearchSummary& summary);
+
+    SearchOptions settings;
+    NameMatcher matcher;
+    PruneRules prune;
+    MetadataFilter filter;
+
+    std::mutex walkerLock; // guards walker against cancel()
+    ParallelWalker* walker = nullptr;
+    std::atomic<bool> cancelled{false};
+};
+
+// run options with one Searcher and return its summary
+SearchSummary search(SearchOptions options, const SearchCallback& onResult, const SearchErrorHandler& onError = nullptr);
+
+// pull interface: the search runs on a thread of its own and hands its matches over in
+// batches, copying each path once; the search waits while a full batch was not taken yet
+class SearchIterator {
+public:
+    // starts the search right away; throws like Searcher's constructor
+    explicit SearchIterator(SearchOptions options, SearchErrorHandler onError = nullptr);
+    // cancels the search if it is still running
+    ~SearchIterator();
+    SearchIterator(const SearchIterator&) = delete;
+    SearchIterator& operator=(const SearchIterator&) = delete;
+
+    // the next match, false once there is none; rethrows what the search threw
+    bool next(SearchResult& result);
+    // complete once next() returned false
+    const SearchSummary& summary() const { return finished; }
+
+private:
+    struct Batch {
+        struct Entry {
+            size_t pattern;
+            size_t offset;        // into paths
+            size_t directorySize;
+            size_t nameOffset;    // name is paths[nameOffset, end)
+            size_t end;
+            bool isDirectory;
+            unsigned worker;
+        };
+        std::vector<Entry> entries;
+        std::string paths; // every joined path back to back
+    };
+
+    void add(const SearchResult& result);
+
+    Searcher searcher;
+    std::mutex lock;
+    std::condition_variable changed;
+    Batch filling;    // written by the search under lock
+    Batch reading;    // owned by next()
+    size_t position = 0;
+    bool done = false;
+    bool stopping = false;
+    std::exception_ptr error;
+    SearchSummary finished;
+    std::thread worker;
+};
+
+#endif
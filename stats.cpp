@@ -0,0 +1,153 @@
+#include "stats.hpp"
+
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+
+#include "output.hpp"
+
+namespace {
+
+// counters of all workers added up
+WalkStatistics total(const SearchStatistics& statistics) {
+    WalkStatistics sum;
+    for (const auto& worker : statistics.workers) {
+        sum.directories += worker.directories;
+        sum.entries += worker.entries;
+        sum.statCalls += worker.statCalls;
+        sum.directoryReads += worker.directoryReads;
+        sum.direntBytes += worker.direntBytes;
+        sum.permissionDenied += worker.permissionDenied;
+        sum.cpuSeconds += worker.cpuSeconds;
+    }
+    sum.wallSeconds = statistics.wallSeconds;
+    return sum;
+}
+
+uint64_t totalMatches(const SearchStatistics& statistics) {
+    uint64_t sum = 0;
+    for (uint64_t matches : statistics.matches) {
+        sum += matches;
+    }
+    return sum;
+}
+
+const char* sourceName(SearchSource source) {
+    switch (source) {
+        case SearchSource::Walk: return "walk";
+        case SearchSource::Index: return "index";
+        case SearchSource::Daemon: return "daemon";
+    }
+    return "walk";
+}
+
+double perSecond(uint64_t count, double seconds) {
+    return seconds > 0 ? count / seconds : 0;
+}
+
+void appendText(std::ostringstream& report, const WalkStatistics& counters, uint64_t matches) {
+    report << counters.wallSeconds << " s wall, " << counters.cpuSeconds << " s CPU, " << counters.directories
+           << " directories, " << counters.entries << " entries, "
+           << static_cast<uint64_t>(perSecond(counters.entries, counters.wallSeconds)) << " entries/s, " << matches
+           << " matches, " << counters.statCalls << " stat calls, " << counters.directoryReads << " getdents calls, "
+           << counters.direntBytes << " dirent bytes, "
+           << counters.permissionDenied << " permission denied\n";
+}
+
+// names and patterns may contain anything but NUL
+void appendQuoted(std::ostringstream& report, std::string_view text) {
+    std::string quoted;
+    appendJsonString(quoted, text);
+    report << quoted;
+}
+
+void appendJson(std::ostringstream& report, const WalkStatistics& counters, uint64_t matches) {
+    report << "\"wallSeconds\":" << counters.wallSeconds << ",\"cpuSeconds\":" << counters.cpuSeconds
+           << ",\"directories\":" << counters.directories << ",\"entries\":" << counters.entries
+           << ",\"entriesPerSecond\":" << perSecond(counters.entries, counters.wallSeconds) << ",\"matches\":" << matches
+           << ",\"statCalls\":" << counters.statCalls << ",\"directoryReads\":" << counters.directoryReads
+           << ",\"direntBytes\":" << counters.direntBytes
+           << ",\"permissionDenied\":" << counters.permissionDenied;
+}
+
+} // namespace
+
+std::string formatStatistics(const SearchStatistics& statistics, const NameMatcher& names, pid_t pid,
+                             SearchSource source) {
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3);
+    if (!statistics.workers.empty()) {
+        report << pid << ": walk: " << statistics.workers.size() << " threads, ";
+        appendText(report, total(statistics), totalMatches(statistics));
+        for (size_t i = 0; i < statistics.workers.size() && statistics.workers.size() > 1; ++i) {
+            report << pid << ": worker " << i << ": ";
+            appendText(report, statistics.workers[i], statistics.matches[i]);
+        }
+    } else {
+        // the index and the daemon count nothing of their own
+        report << pid << ": " << sourceName(source) << ": " << statistics.wallSeconds << " s wall, "
+               << totalMatches(statistics) << " matches\n";
+    }
+
+    const std::vector<std::string>& filenames = names.patterns();
+    const auto& regexes = names.regexPatterns();
+    for (size_t i = 0; i < regexes.size(); ++i) {
+        RegexStatistics regex = regexes[i]->statistics();
+        double seconds = regex.nanoseconds / 1e9;
+        report << pid << ": regex " << filenames[i] << ": compiled in " << regexes[i]->compileMilliseconds()
+               << " ms, literal " << std::quoted(regexes[i]->requiredLiteral()) << ", " << regex.names
+               << " names, " << regex.prefilterRejects << " rejected by literal, " << regex.matches
+               << " matched, " << regex.dfaStates << " DFA states";
+        if (regex.dfaFlushes > 0) {
+            report << " (" << regex.dfaFlushes << " flushes)";
+        }
+        if (regex.timedNames > 0 && seconds > 0) {
+            report << ", " << regex.nanoseconds / static_cast<double>(regex.timedNames) << " ns/name, "
+                   << regex.timedBytes / seconds / 1e6 << " MB/s";
+        }
+        report << "\n";
+    }
+    return report.str();
+}
+
+std::string formatStatisticsJson(const SearchStatistics& statistics, const NameMatcher& names, pid_t pid,
+                                 SearchSource source) {
+    std::ostringstream report;
+    report << std::setprecision(6);
+    report << "{\"pid\":" << pid << ",\"source\":\"" << sourceName(source) << "\"";
+    if (statistics.workers.empty()) {
+        report << ",\"wallSeconds\":" << statistics.wallSeconds << ",\"matches\":" << totalMatches(statistics);
+    } else {
+        report << ",\"threads\":" << statistics.workers.size() << ",";
+        appendJson(report, total(statistics), totalMatches(statistics));
+        report << ",\"workers\":[";
+        for (size_t i = 0; i < statistics.workers.size(); ++i) {
+            report << (i > 0 ? ",{" : "{");
+            appendJson(report, statistics.workers[i], statistics.matches[i]);
+            report << "}";
+        }
+        report << "]";
+    }
+
+    const std::vector<std::string>& filenames = names.patterns();
+    const auto& regexes = names.regexPatterns();
+    report << ",\"regexes\":[";
+    for (size_t i = 0; i < regexes.size(); ++i) {
+        RegexStatistics regex = regexes[i]->statistics();
+        double seconds = regex.nanoseconds / 1e9;
+        report << (i > 0 ? ",{" : "{") << "\"pattern\":";
+        appendQuoted(report, filenames[i]);
+        report << ",\"compileMilliseconds\":" << regexes[i]->compileMilliseconds() << ",\"literal\":";
+        appendQuoted(report, regexes[i]->requiredLiteral());
+        report << ",\"names\":" << regex.names << ",\"prefilterRejects\":" << regex.prefilterRejects
+               << ",\"matches\":" << regex.matches << ",\"dfaStates\":" << regex.dfaStates
+               << ",\"dfaFlushes\":" << regex.dfaFlushes;
+        if (regex.timedNames > 0 && seconds > 0) {
+            report << ",\"nanosecondsPerName\":" << regex.nanoseconds / static_cast<double>(regex.timedNames)
+                   << ",\"megabytesPerSecond\":" << regex.timedBytes / seconds / 1e6;
+        }
+        report << "}";
+    }
+    report << "]}\n";
+    return report.str();
+}
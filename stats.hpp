@@ -0,0 +1,36 @@
+#ifndef MYFIND_STATS_HPP
+#define MYFIND_STATS_HPP
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "match.hpp"
+#include "walk.hpp"
+
+// where the matches of a search came from
+enum class SearchSource {
+    Walk,
+    Index,
+    Daemon,
+};
+
+// --stats: what one search process did. Workers count into their own WalkStatistics during
+// the walk, the counters are only added up here, once the walk is over
+struct SearchStatistics {
+    std::vector<WalkStatistics> workers; // one per walker thread, empty if the tree was not walked
+    std::vector<uint64_t> matches;       // reported matches, per worker; one total for index and daemon
+    double wallSeconds = 0;              // the whole walk, index lookup or daemon query
+};
+
+// one line for the search, one per worker and one per regex, each starting with "<pid>: "
+std::string formatStatistics(const SearchStatistics& statistics, const NameMatcher& names, pid_t pid,
+                             SearchSource source);
+
+// the same as a single JSON object on one line, so the reports of several processes
+// (one per filename without -s) can be read as JSON lines
+std::string formatStatisticsJson(const SearchStatistics& statistics, const NameMatcher& names, pid_t pid,
+                                 SearchSource source);
+
+#endif
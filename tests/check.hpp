@@ -0,0 +1,30 @@
+#ifndef MYFIND_TESTS_CHECK_HPP
+#define MYFIND_TESTS_CHECK_HPP
+
+#include <iostream>
+#include <string>
+
+// minimal checks for make check: a failed CHECK prints where it is and what it tested,
+// finish() reports the totals and gives the exit code
+inline int checksRun = 0;
+inline int checksFailed = 0;
+
+inline bool check(bool passed, const std::string& what, const char* file, int line) {
+    ++checksRun;
+    if (!passed) {
+        ++checksFailed;
+        std::cerr << file << ":" << line << ": failed: " << what << "\n";
+    }
+    return passed;
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+// the same with a description of the case, for checks run in a loop over a table
+#define CHECK_CASE(condition, description) check((condition), std::string(#condition) + " for " + (description), __FILE__, __LINE__)
+
+inline int finish(const char* test) {
+    std::cout << test << ": " << checksRun - checksFailed << "/" << checksRun << " checks passed\n";
+    return checksFailed == 0 ? 0 : 1;
+}
+
+#endif
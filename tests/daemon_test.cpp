@@ -0,0 +1,166 @@
+// the daemon: one started on a temporary tree has to answer like a walk and follow changes,
+// and queryDaemon has to return false without reporting anything when the peer sends a
+// malformed answer or none at all
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../daemon.hpp"
+#include "../search.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path) {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// "name:relative path" for everything the daemon reports, answered tells whether it did
+std::set<std::string> ask(const std::string& socketPath, const std::string& directory,
+                          const std::vector<std::string>& names, bool recursive, bool ignoreCase, bool& answered) {
+    std::set<std::string> paths;
+    answered = queryDaemon(socketPath, directory, names, recursive, ignoreCase, [&](size_t index, std::string_view path) {
+        paths.insert(names[index] + ":" + std::string(path));
+    });
+    return paths;
+}
+
+// a peer that reads one request and sends answer, or nothing for a while if stall is set
+void fakeDaemon(int listener, std::string answer, bool stall) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+        return;
+    }
+    char buffer[4096];
+    while (recv(client, buffer, sizeof(buffer), 0) > 0) {
+    }
+    if (stall) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    } else if (send(client, answer.data(), answer.size(), MSG_NOSIGNAL) < 0) {
+        answer.clear();
+    }
+    close(client);
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/myfind-daemon-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "daemon_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    const fs::path tree = top / "tree";
+    const std::string socketPath = (top / "daemon.sock").native();
+    writeFile(tree / "main.c");
+    writeFile(tree / "src" / "main.c");
+    writeFile(tree / "src" / "MAIN.C");
+    writeFile(tree / "src" / "lib" / "util.c");
+
+    pid_t daemon = fork();
+    if (daemon == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        _exit(runDaemon(tree.native(), socketPath));
+    }
+    for (int i = 0; i < 500 && !fs::exists(socketPath); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    bool answered = false;
+    CHECK(ask(socketPath, tree.native(), {"main.c"}, false, false, answered) == std::set<std::string>({"main.c:main.c"}));
+    CHECK(answered);
+    CHECK(ask(socketPath, tree.native(), {"main.c", "util.c"}, true, false, answered)
+          == std::set<std::string>({"main.c:main.c", "main.c:src/main.c", "util.c:src/lib/util.c"}));
+    CHECK(ask(socketPath, (tree / "src").native() + "/", {"main.c"}, true, true, answered)
+          == std::set<std::string>({"main.c:main.c", "main.c:MAIN.C"}));
+    CHECK(ask(socketPath, tree.native(), {"missing"}, true, false, answered).empty() && answered);
+    // outside its root the daemon cannot answer and the caller walks
+    CHECK(ask(socketPath, top.native(), {"main.c"}, true, false, answered).empty() && !answered);
+
+    // changes arrive through inotify
+    writeFile(tree / "src" / "lib" / "new.c");
+    fs::remove(tree / "main.c");
+    std::set<std::string> changed;
+    for (int i = 0; i < 100; ++i) {
+        changed = ask(socketPath, tree.native(), {"new.c", "main.c"}, true, false, answered);
+        if (changed.count("new.c:src/lib/new.c") > 0 && changed.count("main.c:main.c") == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    CHECK(changed == std::set<std::string>({"new.c:src/lib/new.c", "main.c:src/main.c"}));
+
+    // through a Searcher: the daemon answers plain names, a glob is walked
+    SearchOptions options;
+    options.root = tree.native();
+    options.filenames = {"util.c"};
+    options.recursive = true;
+    options.daemonSocket = socketPath;
+    SearchSummary summary = search(options, [](const SearchResult&) {});
+    CHECK(summary.source == SearchSource::Daemon);
+    CHECK(summary.hits == std::vector<size_t>({1}));
+    options.filenames = {"*.c"};
+    summary = search(options, [](const SearchResult&) {});
+    CHECK(summary.source == SearchSource::Walk);
+
+    kill(daemon, SIGTERM);
+    int status = 0;
+    waitpid(daemon, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(!fs::exists(socketPath));
+
+    // a peer that answers garbage, half an answer or nothing at all
+    const std::string fakePath = (top / "fake.sock").native();
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    fakePath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    CHECK(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 && listen(listener, 4) == 0);
+    using namespace std::string_literals;
+    const std::vector<std::pair<const char*, std::string>> answers = {
+        {"not a number", "OK\nabc\0main.c\0"s},
+        {"number with trailing bytes", "OK\n0x\0main.c\0"s},
+        {"number too large", "OK\n99999999999999999999999\0main.c\0"s},
+        {"name number out of range", "OK\n5\0main.c\0"s},
+        {"valid pair then a cut off one", "OK\n0\0main.c\0" "0\0src"s},
+        {"refusal", "NO unknown directory\n"s},
+        {"empty", ""s},
+    };
+    for (const auto& answer : answers) {
+        std::thread peer(fakeDaemon, listener, answer.second, false);
+        bool reported = false;
+        answered = queryDaemon(fakePath, tree.native(), {"main.c"}, true, false,
+                               [&](size_t, std::string_view) { reported = true; });
+        peer.join();
+        CHECK_CASE(!answered && !reported, answer.first);
+    }
+    std::thread peer(fakeDaemon, listener, "", true);
+    auto start = std::chrono::steady_clock::now();
+    answered = queryDaemon(fakePath, tree.native(), {"main.c"}, true, false, [](size_t, std::string_view) {});
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    peer.join();
+    CHECK(!answered);
+    CHECK(seconds < 0.9); // gave up on the stalled peer before it hung up
+    close(listener);
+
+    fs::remove_all(top);
+    return finish("daemon_test");
+}
@@ -0,0 +1,150 @@
+// -type, -size, -mtime, -newer and -perm: the predicates are checked on a temporary tree with
+// known sizes, modes and times, directly through MetadataFilter and through a Searcher with
+// every backend, and invalid arguments have to be refused with std::invalid_argument
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "../filter.hpp"
+#include "../search.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path, size_t size, mode_t mode, int daysOld) {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    std::string bytes(size, 'x');
+    if (write(fd, bytes.data(), bytes.size()) < 0) {
+        bytes.clear();
+    }
+    close(fd);
+    chmod(path.c_str(), mode);
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = time(nullptr) - daysOld * 86400 - 60;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+}
+
+using Predicates = std::vector<std::pair<std::string, std::string>>;
+
+// names below root that a recursive search for "*" with predicates reports
+std::set<std::string> search(const fs::path& root, const Predicates& predicates, Backend backend, unsigned threads = 1) {
+    SearchOptions options;
+    options.root = root.native();
+    options.filenames = {"*"};
+    options.recursive = true;
+    options.backend = backend;
+    options.threads = threads;
+    options.metadataPredicates = predicates;
+    std::set<std::string> names;
+    std::mutex lock;
+    ::search(options, [&](const SearchResult& result) {
+        std::lock_guard<std::mutex> guard(lock);
+        names.insert(fs::path(std::string(result.path())).lexically_relative(root).native());
+    });
+    return names;
+}
+
+bool refused(const std::string& predicate, const std::string& argument) {
+    try {
+        MetadataFilter filter;
+        filter.add(predicate, argument);
+    } catch (const std::invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/myfind-filter-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "filter_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    writeFile(top / "empty", 0, 0644, 0);
+    writeFile(top / "small", 100, 0600, 1);
+    writeFile(top / "block", 512, 0755, 3);
+    writeFile(top / "big", 3000, 0640, 10);
+    writeFile(top / "sub" / "kilo", 2048, 0444, 30);
+    fs::create_symlink("big", top / "link");
+    fs::create_symlink("missing", top / "dangling");
+    writeFile(top / "reference", 0, 0644, 5);
+
+    // MetadataFilter on its own, with and without the type from getdents
+    {
+        MetadataFilter filter;
+        filter.add("type", "f");
+        filter.add("size", "+1k");
+        uint64_t lookups = 0;
+        CHECK(filter.matches(-1, top.native(), "big", DT_REG, lookups));
+        CHECK(filter.matches(-1, top.native(), "big", DT_UNKNOWN, lookups));
+        CHECK(!filter.matches(-1, top.native(), "small", DT_REG, lookups));
+        CHECK(!filter.matches(-1, top.native(), "sub", DT_DIR, lookups));
+        CHECK(lookups == 3); // sub was decided by its d_type alone
+        MetadataFilter types;
+        types.add("type", "d");
+        lookups = 0;
+        CHECK(!types.matches(-1, top.native(), "big", DT_REG, lookups));
+        CHECK(types.matches(-1, top.native(), "sub", DT_UNKNOWN, lookups));
+        CHECK(lookups == 1);
+    }
+
+    const std::vector<std::pair<Predicates, std::set<std::string>>> cases = {
+        {{{"type", "f"}}, {"empty", "small", "block", "big", "sub/kilo", "reference"}},
+        {{{"type", "d"}}, {"sub"}},
+        {{{"type", "l"}}, {"link", "dangling"}},
+        {{{"type", "d,l"}}, {"sub", "link", "dangling"}},
+        {{{"type", "f"}, {"size", "0"}}, {"empty", "reference"}},
+        {{{"size", "100c"}, {"type", "f"}}, {"small"}},
+        {{{"size", "1"}, {"type", "f"}}, {"small", "block"}}, // 512 byte blocks, rounded up
+        {{{"size", "+2k"}, {"type", "f"}}, {"big"}},
+        {{{"size", "-2k"}, {"type", "f"}}, {"empty", "small", "block", "reference"}},
+        {{{"size", "2k"}, {"type", "f"}}, {"sub/kilo"}},
+        {{{"type", "f"}, {"mtime", "-2"}}, {"empty", "small"}},
+        {{{"type", "f"}, {"mtime", "+7"}}, {"big", "sub/kilo"}},
+        {{{"mtime", "3"}, {"type", "f"}}, {"block"}},
+        {{{"type", "f"}, {"newer", (top / "reference").native()}}, {"empty", "small", "block"}},
+        {{{"type", "f"}, {"perm", "644"}}, {"empty", "reference"}},
+        {{{"type", "f"}, {"perm", "-640"}}, {"empty", "block", "big", "reference"}},
+        {{{"type", "f"}, {"perm", "/011"}}, {"block"}},
+        {{{"type", "f"}, {"perm", "/0"}}, {"empty", "small", "block", "big", "sub/kilo", "reference"}},
+    };
+    for (Backend backend : {Backend::Getdents, Backend::Uring, Backend::Filesystem}) {
+        for (const auto& test : cases) {
+            std::string description = test.first[0].first + " " + test.first[0].second;
+            if (test.first.size() > 1) {
+                description += " -" + test.first[1].first + " " + test.first[1].second;
+            }
+            CHECK_CASE(search(top, test.first, backend) == test.second, description);
+        }
+        CHECK(search(top, {{"size", "+2k"}, {"type", "f"}}, backend, 4) == std::set<std::string>({"big"}));
+    }
+
+    for (const auto& invalid : std::vector<std::pair<std::string, std::string>>{
+             {"type", "x"}, {"type", "f,"}, {"type", "fd"}, {"size", "1x"}, {"size", ""},
+             {"mtime", "abc"}, {"perm", "u+x"}, {"perm", "17777"}, {"newer", (top / "missing").native()},
+             {"owner", "root"}}) {
+        CHECK_CASE(refused(invalid.first, invalid.second), invalid.first + " " + invalid.second);
+    }
+
+    fs::remove_all(top);
+    return finish("filter_test");
+}
@@ -0,0 +1,112 @@
+// GlobPattern against fnmatch(3) on a corpus of names, plus the brace expansion and
+// escapes fnmatch does not have
+#include <fnmatch.h>
+#include <string>
+#include <vector>
+
+#include "../match.hpp"
+#include "check.hpp"
+
+namespace {
+
+struct Case {
+    const char* pattern;
+    const char* name;
+    bool ignoreCase;
+    bool expected;
+};
+
+// fnmatch has no braces, these are what a shell's expansion followed by fnmatch gives
+const Case braceCases[] = {
+    {"*.{c,h}", "main.c", false, true},
+    {"*.{c,h}", "main.h", false, true},
+    {"*.{c,h}", "main.o", false, false},
+    {"{a,b}{c,d}", "bd", false, true},
+    {"{a,b}{c,d}", "ab", false, false},
+    {"x{a,{b,c}}y", "xcy", false, true},    // nested
+    {"x{a,{b,c}}y", "x{b,c}y", false, false},
+    {"{,pre}fix", "fix", false, true},      // empty alternative
+    {"{,pre}fix", "prefix", false, true},
+    {"{a}", "{a}", false, true},            // no comma: not a group
+    {"{a}", "a", false, false},
+    {"{a,b", "{a,b", false, true},          // not closed: literal
+    {"\\{a,b}", "{a,b}", false, true},      // escaped brace
+    {"\\{a,b}", "a", false, false},
+    {"[{]a,b}", "{a,b}", false, true},      // brace inside a class
+    {"{*.TXT,*.md}", "notes.txt", true, true},
+    {"{*.TXT,*.md}", "notes.txt", false, false},
+    {"a\\*b", "a*b", false, true},          // escaped wildcards are literals
+    {"a\\*b", "axb", false, false},
+    {"a\\?", "a?", false, true},
+    {"[]]", "]", false, true},              // leading ']' is part of the class
+    {"[!]]", "a", false, true},
+    {"[!]]", "]", false, false},
+    {"[a-]", "-", false, true},             // trailing '-' is a literal
+    {"[", "[", false, true},                // unclosed class: literal
+    {"a[", "a[", false, true},
+};
+
+// every pattern is checked against every name, with and without case folding
+const char* const fnmatchPatterns[] = {
+    "*", "?", "*.c", "*.C", "a*", "*a*", "a*b*c", "*.tar.gz", "??", "???*", "[abc]*", "[!abc]*", "[a-c]?",
+    "[^a-c]*", "*[0-9]", "file[0-9][0-9].txt", "*.[ch]", "a?c", "*x*y*z*", "Make*", "*file", "a**b", "*.*",
+    "[A-Z]*", "[[:]", "*[-]*", "abc", "ABC", ".*", "*~",
+};
+
+std::vector<std::string> corpus() {
+    std::vector<std::string> names = {
+        "", "a", "b", "abc", "ABC", "aXbYc", "ab", "ac", "abbc", "main.c", "main.h", "main.C", "MAIN.c",
+        "archive.tar.gz", "archive.tar.GZ", "file01.txt", "file1.txt", "fileAB.txt", "Makefile", "makefile",
+        ".hidden", "notes~", "x-y", "xyz", "x_y_z", "a.b.c", "7", "z9", "[", ":", "-", "aaab", "ba",
+        "caab", "a\xc3\xa9", "\xff",
+    };
+    // every string of up to three of these bytes, which reaches the NFA's corner cases
+    const std::string alphabet = "abAB.*";
+    for (char a : alphabet) {
+        names.push_back(std::string(1, a));
+        for (char b : alphabet) {
+            names.push_back(std::string{a, b});
+            for (char c : alphabet) {
+                names.push_back(std::string{a, b, c});
+            }
+        }
+    }
+    return names;
+}
+
+} // namespace
+
+int main() {
+    for (const Case& test : braceCases) {
+        GlobPattern glob(test.pattern, test.ignoreCase);
+        std::string description = std::string(test.pattern) + " / " + test.name + (test.ignoreCase ? " -i" : "");
+        CHECK_CASE(glob.matches(test.name) == test.expected, description);
+    }
+
+    const std::vector<std::string> names = corpus();
+    for (const char* pattern : fnmatchPatterns) {
+        for (bool ignoreCase : {false, true}) {
+            GlobPattern glob(pattern, ignoreCase);
+            for (const auto& name : names) {
+                bool expected = fnmatch(pattern, name.c_str(), ignoreCase ? FNM_CASEFOLD : 0) == 0;
+                std::string description = std::string(pattern) + " / \"" + name + "\"" + (ignoreCase ? " -i" : "");
+                CHECK_CASE(glob.matches(name) == expected, description);
+            }
+        }
+    }
+
+    CHECK(GlobPattern::isGlob("*.c"));
+    CHECK(GlobPattern::isGlob("{a,b}"));
+    CHECK(GlobPattern::isGlob("[ab]"));
+    CHECK(!GlobPattern::isGlob("plain.txt"));
+    CHECK(!GlobPattern::isGlob("\\*.c"));
+    CHECK(!GlobPattern::isGlob("["));
+    CHECK(GlobPattern::unescape("a\\*b\\\\c") == "a*b\\c");
+
+    // a NameMatcher with plain names and globs together reports each of them
+    NameMatcher matcher({"main.c", "*.c", "{x,main}.?"}, false);
+    std::vector<size_t> matched;
+    matcher.forEachMatch("main.c", [&](size_t index) { matched.push_back(index); });
+    CHECK(matched.size() == 3);
+    return finish("glob_test");
+}
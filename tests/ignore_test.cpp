@@ -0,0 +1,129 @@
+// --respect-ignore end to end: a work tree with ignore files at several levels is searched
+// through a Searcher, from absolute, relative and "./" roots, and the reported paths are
+// compared with what git's precedence and anchoring rules leave
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "../search.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path, const std::string& text = "") {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        if (write(fd, text.data(), text.size()) < 0) {
+            close(fd);
+            return;
+        }
+        close(fd);
+    }
+}
+
+// every path below root that a recursive search for "*" with --respect-ignore reports,
+// relative to the normalized root
+std::set<std::string> visible(const std::string& root, unsigned threads = 1) {
+    SearchOptions options;
+    options.root = root;
+    options.filenames = {"*"};
+    options.recursive = true;
+    options.respectIgnore = true;
+    options.threads = threads;
+    std::set<std::string> paths;
+    std::mutex lock;
+    SearchSummary summary = search(options, [&](const SearchResult& result) {
+        std::lock_guard<std::mutex> guard(lock);
+        paths.insert(std::string(result.path()));
+    });
+    std::set<std::string> relative;
+    for (const auto& path : paths) {
+        relative.insert(path.substr(summary.root.size() + 1));
+    }
+    return relative;
+}
+
+bool contains(const std::set<std::string>& paths, const std::string& path) {
+    return paths.count(path) > 0;
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/myfind-ignore-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "ignore_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    fs::create_directories(top / ".git");
+    writeFile(top / ".gitignore", "# comment\n*.log\n!keep.log\n/build\ncache/\ndocs/*.tmp\n/src/gen\n**/deep/**/x.o\n");
+    writeFile(top / "a.log");
+    writeFile(top / "keep.log");
+    writeFile(top / "build" / "out");
+    writeFile(top / "cache" / "blob");
+    writeFile(top / "docs" / "draft.tmp");
+    writeFile(top / "docs" / "sub" / "draft.tmp"); // docs/*.tmp does not reach below docs
+    writeFile(top / "src" / "build" / "out");      // /build is anchored to the top
+    writeFile(top / "src" / "gen" / "x");          // /src/gen is
+    writeFile(top / "src" / "main.c");
+    writeFile(top / "src" / "deep" / "a" / "b" / "x.o");
+    writeFile(top / "src" / "deep" / "x.c");
+    writeFile(top / "sub" / ".gitignore", "!debug.log\nlocal\n");
+    writeFile(top / "sub" / "debug.log");           // re-included below the rule that ignored it
+    writeFile(top / "sub" / "trace.log");
+    writeFile(top / "sub" / "local");
+    writeFile(top / "sub" / "cache");               // a file: cache/ only ignores directories
+    writeFile(top / "sub" / ".ignore", "trace.log\n!local\n"); // .ignore wins over .gitignore
+    writeFile(top / "sub" / "more" / "local");
+
+    std::set<std::string> all = visible(top.native());
+    CHECK(!contains(all, "a.log"));
+    CHECK(contains(all, "keep.log"));
+    CHECK(!contains(all, "build"));
+    CHECK(!contains(all, "build/out"));
+    CHECK(!contains(all, "cache"));
+    CHECK(!contains(all, "docs/draft.tmp"));
+    CHECK(contains(all, "docs/sub/draft.tmp"));
+    CHECK(contains(all, "src/build/out"));
+    CHECK(!contains(all, "src/gen"));
+    CHECK(!contains(all, "src/gen/x"));
+    CHECK(contains(all, "src/main.c"));
+    CHECK(!contains(all, "src/deep/a/b/x.o"));
+    CHECK(contains(all, "src/deep/x.c"));
+    CHECK(contains(all, "sub/debug.log"));
+    CHECK(!contains(all, "sub/trace.log"));
+    CHECK(contains(all, "sub/local"));
+    CHECK(contains(all, "sub/more/local"));
+    CHECK(contains(all, "sub/cache"));
+    CHECK(contains(all, ".gitignore"));
+    CHECK(visible(top.native(), 4) == all);
+
+    // rules of directories above the search path apply too, however the path is spelled
+    const std::set<std::string> src = visible((top / "src").native());
+    CHECK(!contains(src, "gen/x"));
+    CHECK(contains(src, "build/out"));
+    CHECK(contains(src, "main.c"));
+    const fs::path previous = fs::current_path();
+    fs::current_path(top / "src");
+    for (const char* root : {".", "./", "./.", "../src", "../src/", "gen/.."}) {
+        std::set<std::string> found = visible(root);
+        CHECK_CASE(found == src, root);
+        CHECK_CASE(!contains(found, "gen/x"), root);
+    }
+    fs::current_path(top / "sub");
+    CHECK(visible(".") == visible((top / "sub").native()));
+    CHECK(contains(visible("."), "debug.log"));
+    fs::current_path(previous);
+
+    fs::remove_all(top);
+    return finish("ignore_test");
+}
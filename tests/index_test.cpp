@@ -0,0 +1,179 @@
+// index files: an index of a temporary tree has to answer name lookups, entry and directory
+// listings like the tree itself, survive --update-index, and every section of the file has
+// to be rejected with std::runtime_error once a byte of it is flipped
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "../index.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path) {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+std::string readBytes(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeBytes(const std::string& file, const std::string& bytes) {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+uint64_t getU64(const std::string& bytes, size_t offset) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[offset + i])) << (8 * i);
+    }
+    return value;
+}
+
+// every relative path in the index, directories with a trailing '/'
+std::set<std::string> listed(const IndexReader& reader) {
+    std::set<std::string> paths;
+    reader.forEachEntry([&](uint64_t, std::string_view path, bool isDirectory) {
+        paths.insert(std::string(path) + (isDirectory ? "/" : ""));
+    });
+    return paths;
+}
+
+std::set<std::string> found(const IndexReader& reader, std::string_view name, bool ignoreCase) {
+    std::set<std::string> paths;
+    reader.findName(name, ignoreCase, [&](std::string_view path, bool) {
+        paths.insert(std::string(path));
+    });
+    return paths;
+}
+
+// opens the index and reads every section, so lazily checked path blocks count too
+bool readsCleanly(const std::string& indexFile) {
+    try {
+        IndexReader reader(indexFile);
+        listed(reader);
+        found(reader, "main.c", true);
+        reader.forEachDirectory([](uint64_t, const DirectoryStatus&) {});
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/myfind-index-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "index_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    const fs::path tree = top / "tree";
+    const std::string indexFile = (top / "tree.idx").native();
+    writeFile(tree / "main.c");
+    writeFile(tree / "src" / "main.c");
+    writeFile(tree / "src" / "Main.C");
+    writeFile(tree / "src" / "util" / "strings.h");
+    writeFile(tree / "docs" / "readme.md");
+    fs::create_directories(tree / "empty");
+    // enough entries for several path blocks
+    for (int i = 0; i < 150; ++i) {
+        writeFile(tree / "many" / ("file" + std::to_string(i) + ".txt"));
+    }
+
+    const std::set<std::string> expected = [&] {
+        std::set<std::string> paths;
+        for (const auto& entry : fs::recursive_directory_iterator(tree)) {
+            paths.insert(entry.path().lexically_relative(tree).native() + (entry.is_directory() ? "/" : ""));
+        }
+        return paths;
+    }();
+
+    for (Backend backend : {Backend::Getdents, Backend::Filesystem}) {
+        buildIndex(indexFile, (tree / "src" / "..").native(), 2, backend);
+        IndexReader reader(indexFile);
+        CHECK(reader.root() == tree.native());
+        CHECK(reader.size() == expected.size());
+        CHECK(listed(reader) == expected);
+        CHECK(found(reader, "main.c", false) == std::set<std::string>({"main.c", "src/main.c"}));
+        CHECK(found(reader, "main.c", true) == std::set<std::string>({"main.c", "src/main.c", "src/Main.C"}));
+        CHECK(found(reader, "strings.h", false) == std::set<std::string>({"src/util/strings.h"}));
+        CHECK(found(reader, "file149.txt", false) == std::set<std::string>({"many/file149.txt"}));
+        CHECK(found(reader, "missing", true).empty());
+        size_t directories = 0;
+        bool sawRoot = false;
+        reader.forEachDirectory([&](uint64_t entry, const DirectoryStatus& status) {
+            ++directories;
+            sawRoot = sawRoot || entry == UINT32_MAX;
+            CHECK(status.inode != 0);
+        });
+        CHECK(sawRoot);
+        CHECK(directories == 1 + static_cast<size_t>(std::count_if(expected.begin(), expected.end(),
+                                                                  [](const std::string& path) { return path.back() == '/'; })));
+    }
+
+    // --update-index picks up what changed since
+    writeFile(tree / "src" / "added.c");
+    fs::remove(tree / "docs" / "readme.md");
+    updateIndex(indexFile, 1, Backend::Getdents);
+    {
+        IndexReader reader(indexFile);
+        std::set<std::string> updated = expected;
+        updated.insert("src/added.c");
+        updated.erase("docs/readme.md");
+        CHECK(listed(reader) == updated);
+        CHECK(found(reader, "added.c", false) == std::set<std::string>({"src/added.c"}));
+        CHECK(found(reader, "readme.md", false).empty());
+    }
+    // replaced through a synced temporary file that does not stay behind
+    CHECK(!fs::exists(indexFile + ".tmp"));
+
+    // one flipped byte in any section is an error, not a wrong answer
+    const std::string original = readBytes(indexFile);
+    CHECK(readsCleanly(indexFile));
+    const size_t pathsOffset = getU64(original, 48);
+    const size_t blockTableOffset = getU64(original, 64);
+    const size_t namesOffset = getU64(original, 80);
+    const size_t directoriesOffset = getU64(original, 88);
+    const std::vector<std::pair<const char*, size_t>> sections = {
+        {"header", 24},
+        {"root", getU64(original, 32) + 1},
+        {"first path block", pathsOffset + 2},
+        {"last path block", blockTableOffset - 9},
+        {"block table", blockTableOffset + 12},
+        {"first name slot", namesOffset},
+        {"last name slot", directoriesOffset - 1},
+        {"first directory record", directoriesOffset + 8},
+        {"last directory record", original.size() - 1},
+    };
+    for (const auto& section : sections) {
+        std::string corrupt = original;
+        corrupt[section.second] ^= 0x10;
+        writeBytes(indexFile, corrupt);
+        CHECK_CASE(!readsCleanly(indexFile), section.first);
+    }
+    writeBytes(indexFile, original.substr(0, original.size() - 1));
+    CHECK(!readsCleanly(indexFile));
+    writeBytes(indexFile, original);
+    CHECK(readsCleanly(indexFile));
+
+    fs::remove_all(top);
+    return finish("index_test");
+}
@@ -0,0 +1,96 @@
+// case-insensitive name comparison: the SSE2/AVX2 kernel behind equalsFolded against
+// foldCase at every length around the vector widths, and NameMatcher with -i for few and
+// many names and with --contains
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../match.hpp"
+#include "check.hpp"
+
+namespace {
+
+// same xorshift as the benchmarks, the cases are the same on every run
+struct Random {
+    uint64_t state = 88172645463325252ull;
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+// letters of both cases, the bytes next to 'A'/'Z'/'a'/'z' and non-ASCII bytes, which a
+// signed compare in the kernel would get wrong
+const char interesting[] = "aAzZ@[`{09_-.\x80\xc3\xa9\xff";
+
+std::vector<size_t> matches(const NameMatcher& matcher, std::string_view name) {
+    std::vector<size_t> indices;
+    matcher.forEachMatch(name, [&](size_t index) { indices.push_back(index); });
+    return indices;
+}
+
+} // namespace
+
+int main() {
+    Random random;
+    for (size_t size = 0; size <= 100; ++size) {
+        for (int round = 0; round < 40; ++round) {
+            std::string name;
+            for (size_t i = 0; i < size; ++i) {
+                name += interesting[random.next() % (sizeof(interesting) - 1)];
+            }
+            std::string folded = foldCase(name);
+            CHECK_CASE(equalsFolded(name, folded), "size " + std::to_string(size));
+            if (size == 0) {
+                continue;
+            }
+            // one byte changed anywhere, including the last one of a partial block
+            std::string other = folded;
+            size_t position = round == 0 ? size - 1 : random.next() % size;
+            other[position] = other[position] == 'q' ? 'r' : 'q';
+            CHECK_CASE(equalsFolded(name, other) == (folded == other),
+                       "size " + std::to_string(size) + " position " + std::to_string(position));
+        }
+    }
+    CHECK(foldCase("MiXeD.TXT") == "mixed.txt");
+    CHECK(foldCase("\xc3\x89") == "\xc3\x89"); // only ASCII is folded
+
+    // few names are compared directly, more are hashed: both have to agree
+    for (size_t count : {size_t(2), size_t(50)}) {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < count; ++i) {
+            names.push_back("Name" + std::to_string(i) + ".TXT");
+        }
+        NameMatcher folded(names, true);
+        NameMatcher exact(names, false);
+        std::string description = std::to_string(count) + " names";
+        CHECK_CASE(matches(folded, "name1.txt") == std::vector<size_t>{1}, description);
+        CHECK_CASE(matches(folded, "NAME1.TXT") == std::vector<size_t>{1}, description);
+        CHECK_CASE(matches(folded, "name1.tx").empty(), description);
+        CHECK_CASE(matches(exact, "name1.txt").empty(), description);
+        CHECK_CASE(matches(exact, "Name1.TXT") == std::vector<size_t>{1}, description);
+    }
+    // the same name twice reports both patterns
+    NameMatcher duplicates({"readme", "README"}, true);
+    CHECK(matches(duplicates, "ReadMe") == (std::vector<size_t>{0, 1}));
+
+    // --contains -i against a naive case-folded search
+    std::vector<std::string> substrings = {"ab", "B", "xyz", "Abc", "zz"};
+    NameMatcher contains(substrings, true, MatchMode::Contains);
+    for (const char* name : {"ABC", "xYz", "aabbcc", "nothing", "ZZZ", ""}) {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < substrings.size(); ++i) {
+            if (foldCase(name).find(foldCase(substrings[i])) != std::string::npos) {
+                expected.push_back(i);
+            }
+        }
+        std::vector<size_t> found = matches(contains, name);
+        std::sort(found.begin(), found.end());
+        CHECK_CASE(found == expected, name);
+    }
+    return finish("match_test");
+}
@@ -0,0 +1,97 @@
+// JSON strings in the --stats=json and --trace reports: control characters, quotes and
+// backslashes are escaped, well-formed UTF-8 is kept, and every byte of a name that is not
+// well-formed UTF-8 becomes \u00XX, so a tree with such names still gives valid JSON
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "../output.hpp"
+#include "../search.hpp"
+#include "../stats.hpp"
+#include "../trace.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string asJson(std::string_view text) {
+    std::string out;
+    appendJsonString(out, text);
+    return out;
+}
+
+std::string readBytes(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+int main() {
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"plain.txt", "\"plain.txt\""},
+        {"a\"b\\c", "\"a\\\"b\\\\c\""},
+        {"tab\there\n", "\"tab\\u0009here\\u000a\""},
+        {"caf\xc3\xa9", "\"caf\xc3\xa9\""},                          // two bytes
+        {"\xe2\x82\xac \xf0\x9f\x98\x80", "\"\xe2\x82\xac \xf0\x9f\x98\x80\""}, // three and four
+        {"caf\xe9", "\"caf\\u00e9\""},                                // Latin-1
+        {"\xff\xfe", "\"\\u00ff\\u00fe\""},
+        {"\x80x", "\"\\u0080x\""},                                    // lone continuation byte
+        {"\xc3", "\"\\u00c3\""},                                      // cut off at the end
+        {"\xc3x", "\"\\u00c3x\""},                                    // cut off in the middle
+        {"\xe2\x82", "\"\\u00e2\\u0082\""},
+        {"\xc0\xaf", "\"\\u00c0\\u00af\""},                           // overlong '/'
+        {"\xe0\x80\xaf", "\"\\u00e0\\u0080\\u00af\""},                // overlong '/'
+        {"\xed\xa0\x80", "\"\\u00ed\\u00a0\\u0080\""},                // surrogate
+        {"\xf4\x90\x80\x80", "\"\\u00f4\\u0090\\u0080\\u0080\""},     // past U+10FFFF
+        {"\xf4\x8f\xbf\xbf", "\"\xf4\x8f\xbf\xbf\""},                 // U+10FFFF
+        {"\xc3\xa9\xe9\xc3\xa9", "\"\xc3\xa9\\u00e9\xc3\xa9\""},
+    };
+    for (const auto& test : cases) {
+        CHECK_CASE(asJson(test.first) == test.second, test.second);
+    }
+
+    // a pattern that is not UTF-8 in --stats=json
+    {
+        NameMatcher names({"caf\xe9"}, false, MatchMode::Regex);
+        SearchStatistics statistics;
+        statistics.matches = {0};
+        std::string report = formatStatisticsJson(statistics, names, 1, SearchSource::Walk);
+        CHECK(report.find("\"caf\\u00e9\"") != std::string::npos);
+        CHECK(report.find('\xe9') == std::string::npos);
+    }
+
+    // a directory that is not UTF-8 in a --trace of a walk
+    char pattern[] = "/tmp/myfind-output-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "output_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    const fs::path tree = top / "tree";
+    fs::create_directories(tree / "bad\xff" / "caf\xc3\xa9");
+    const std::string traceFile = (top / "trace.json").native();
+    TraceRecorder trace(2);
+    SearchOptions options;
+    options.root = tree.native();
+    options.filenames = {"*"};
+    options.recursive = true;
+    options.threads = 2;
+    options.trace = &trace;
+    search(options, [](const SearchResult&) {});
+    CHECK(trace.write(traceFile, 1));
+    std::string written = readBytes(traceFile);
+    CHECK(written.find("bad\\u00ff\"") != std::string::npos);
+    CHECK(written.find("bad\\u00ff/caf\xc3\xa9\"") != std::string::npos);
+    CHECK(written.find('\xff') == std::string::npos);
+
+    fs::remove_all(top);
+    return finish("output_test");
+}
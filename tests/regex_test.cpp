@@ -0,0 +1,154 @@
+// RegexPattern against std::regex_search on a corpus of names, with and without -i, plus
+// the expressions it has to reject and patterns created and destroyed on several threads
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../regex.hpp"
+#include "check.hpp"
+
+namespace {
+
+// the syntax RegexPattern supports, where it means the same as ECMAScript's
+const char* const expressions[] = {
+    "abc", "^abc", "abc$", "^abc$", "a.c", "a.*c", "a+b", "ab?c", "a*", "^$", "(ab)+", "(a|b)c",
+    "^(foo|bar|baz)\\.txt$", "[abc]x", "[^abc]x", "[a-z]+[0-9]", "[0-9]{2}", "[0-9]{2,}", "^[0-9]{1,3}$",
+    "x{0}y", "\\d+\\.\\d+", "\\w+_\\w+", "\\s", "\\.json$", "^\\.", "(a|ab)(c|bcd)(d*)", "((a)|b)+$",
+    "a(b|c)*d", "[-a]", "[a-]x", "^.{5}$", "(x|y|z)?$", "Make(file)?", "tar\\.(gz|bz2|xz)$", "^(a+)+$",
+};
+
+struct Case {
+    const char* expression;
+    const char* name;
+    bool expected;
+};
+
+// where POSIX and ECMAScript disagree, RegexPattern follows POSIX: a leading ']' is part of
+// the class and "[:" is no character class
+const Case posixCases[] = {
+    {"[]a]", "]", true},
+    {"[]a]", "a", true},
+    {"[]a]", "b", false},
+    {"[^]a]", "]", false},
+    {"[^]a]", "b", true},
+    {"[[:]", "[", true},
+    {"[[:]", ":", true},
+    {"[[:]", "a", false},
+    {"a{2", "a{2", true}, // a '{' that does not start a count is a literal
+    {"a{2", "aa", false},
+};
+
+std::vector<std::string> corpus() {
+    std::vector<std::string> names = {
+        "", "a", "abc", "ABC", "xabcx", "ac", "aXc", "abbbc", "abd", "abcd", "bc", "cc", "foo.txt", "bar.txt",
+        "baz.txt", "qux.txt", "FOO.TXT", "ax", "dx", "hello2", "12", "123", "1234", "y", "xy", "1.5", "v10.20",
+        "snake_case", "no space", "tab\there", "data.json", "x.json.bak", ".hidden", "abcbcd", "abdd", "aad",
+        "abcbd", "]", "-", "bx", "12345", "Makefile", "Make", "a.tar.gz", "b.tar.xz", "c.tar.zip", "[", ":",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaab", "\xc3\xa9t\xc3\xa9", "\xff\xfe",
+    };
+    // every string of up to three of these bytes
+    const std::string alphabet = "abAB1.";
+    for (char a : alphabet) {
+        names.push_back(std::string(1, a));
+        for (char b : alphabet) {
+            names.push_back(std::string{a, b});
+            for (char c : alphabet) {
+                names.push_back(std::string{a, b, c});
+            }
+        }
+    }
+    return names;
+}
+
+} // namespace
+
+int main() {
+    const std::vector<std::string> names = corpus();
+    for (const char* expression : expressions) {
+        for (bool ignoreCase : {false, true}) {
+            RegexPattern pattern(expression, ignoreCase);
+            std::regex reference(expression, ignoreCase ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript);
+            for (const auto& name : names) {
+                bool expected = std::regex_search(name, reference);
+                std::string description = std::string(expression) + " / \"" + name + "\"" + (ignoreCase ? " -i" : "");
+                CHECK_CASE(pattern.matches(name) == expected, description);
+            }
+        }
+    }
+
+    for (const Case& test : posixCases) {
+        RegexPattern pattern(test.expression, false);
+        CHECK_CASE(pattern.matches(test.name) == test.expected, std::string(test.expression) + " / " + test.name);
+    }
+
+    // the nested counts would need 10^9 nodes, they have to be refused before cloning
+    for (const char* invalid : {"(ab", "ab)", "[ab", "*a", "a{3,1}", "a{1001}", "[z-a]", "\\",
+                                "((((a{1000}){1000}){1000}))", "(a{100}){100,}", "([a-z]{50}|b){300}"}) {
+        bool thrown = false;
+        try {
+            RegexPattern pattern(invalid, false);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        CHECK_CASE(thrown, invalid);
+    }
+
+    // large but within the limit
+    for (const char* large : {"a{1000}", "(ab{3}){500}", "[a-z]{2,900}"}) {
+        bool thrown = false;
+        try {
+            RegexPattern pattern(large, false);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        CHECK_CASE(!thrown, large);
+    }
+
+    RegexPattern literal("needle[0-9]", false);
+    CHECK(literal.requiredLiteral() == "needle");
+
+    // each thread has a DFA of its own; patterns come and go while the threads keep running,
+    // as they do for a library that runs one search after another
+    std::vector<std::thread> threads;
+    std::vector<int> wrong(4, 0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < 200; ++round) {
+                RegexPattern pattern("^item" + std::to_string(round) + "\\.(c|h)$", round % 2 == 1);
+                for (int name = 0; name < 50; ++name) {
+                    std::string candidate = "item" + std::to_string(name) + (name % 2 ? ".c" : ".o");
+                    bool expected = name == round && name % 2 == 1;
+                    wrong[t] += pattern.matches(candidate) != expected;
+                }
+                RegexStatistics statistics = pattern.statistics();
+                wrong[t] += statistics.names != 50;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int t = 0; t < 4; ++t) {
+        CHECK_CASE(wrong[t] == 0, "thread " + std::to_string(t));
+    }
+
+    // one pattern shared by threads adds up their statistics
+    RegexPattern shared("x+y", false);
+    threads.clear();
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) {
+                shared.matches(i % 2 ? "axxy" : "ayx");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    RegexStatistics statistics = shared.statistics();
+    CHECK(statistics.names == 4000);
+    CHECK(statistics.matches == 2000);
+    return finish("regex_test");
+}
@@ -0,0 +1,132 @@
+// libmyfind: a SearchIterator has to hand out the same matches a Searcher reports through its
+// callback, from a walk and from an index, with views that stay valid until the next call;
+// dropping it mid-search or cancelling a Searcher has to end the search
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+#include "../index.hpp"
+#include "../search.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path) {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+using Match = std::tuple<size_t, std::string, bool>; // pattern, path, isDirectory
+
+std::set<Match> throughCallback(const SearchOptions& options, SearchSummary& summary) {
+    std::set<Match> matches;
+    std::mutex lock;
+    summary = search(options, [&](const SearchResult& result) {
+        std::lock_guard<std::mutex> guard(lock);
+        matches.emplace(result.pattern, std::string(result.path()), result.isDirectory);
+    });
+    return matches;
+}
+
+// every match of an iterator; counts a view that changed before the next call in broken
+std::set<Match> throughIterator(const SearchOptions& options, SearchSummary& summary, size_t& count, int& broken) {
+    std::set<Match> matches;
+    SearchIterator iterator(options);
+    SearchResult result;
+    while (iterator.next(result)) {
+        std::string directory(result.directory);
+        std::string name(result.name);
+        std::string path(result.path());
+        broken += path != directory + "/" + name || result.path() != path;
+        matches.emplace(result.pattern, path, result.isDirectory);
+        ++count;
+    }
+    summary = iterator.summary();
+    return matches;
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/myfind-search-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "search_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    const fs::path tree = top / "tree";
+    for (int i = 0; i < 30; ++i) {
+        const fs::path directory = tree / ("dir" + std::to_string(i % 7)) / ("sub" + std::to_string(i));
+        writeFile(directory / "main.c");
+        writeFile(directory / ("file" + std::to_string(i) + ".h"));
+    }
+    const std::string indexFile = (top / "tree.idx").native();
+    buildIndex(indexFile, tree.native(), 1, Backend::Getdents);
+
+    SearchOptions options;
+    options.root = tree.native();
+    options.filenames = {"main.c", "*.h", "sub1*"};
+    options.recursive = true;
+    for (unsigned threads : {1u, 4u}) {
+        for (bool fromIndex : {false, true}) {
+            const std::string description = std::to_string(threads) + " threads" + (fromIndex ? ", index" : "");
+            options.threads = threads;
+            options.indexFile = fromIndex ? indexFile : "";
+            SearchSummary expected;
+            SearchSummary summary;
+            size_t count = 0;
+            int broken = 0;
+            const std::set<Match> reported = throughCallback(options, expected);
+            CHECK_CASE(reported.size() == 30 + 30 + 11, description);
+            CHECK_CASE(throughIterator(options, summary, count, broken) == reported, description);
+            CHECK_CASE(count == reported.size() && broken == 0, description);
+            CHECK_CASE(summary.hits == expected.hits && summary.source == expected.source, description);
+            CHECK_CASE(summary.root == tree.native(), description);
+        }
+    }
+    options.indexFile.clear();
+
+    // a hand-made result joins its path into a buffer of its own
+    SearchResult made;
+    made.directory = "/some/dir";
+    made.name = "file.txt";
+    CHECK(made.path() == "/some/dir/file.txt");
+
+    // dropping an iterator after one match, or cancelling a Searcher before it runs, ends the search
+    {
+        SearchIterator iterator(options);
+        SearchResult result;
+        CHECK(iterator.next(result));
+    }
+    Searcher cancelled(options);
+    cancelled.cancel();
+    size_t late = 0;
+    cancelled.run([&](const SearchResult&) { ++late; });
+    CHECK(late == 0);
+
+    // bad patterns are refused before anything runs
+    options.filenames = {"("};
+    options.matchMode = MatchMode::Regex;
+    bool refused = false;
+    try {
+        SearchIterator iterator(options);
+    } catch (const std::invalid_argument&) {
+        refused = true;
+    }
+    CHECK(refused);
+
+    fs::remove_all(top);
+    return finish("search_test");
+}
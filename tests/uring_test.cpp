@@ -0,0 +1,126 @@
+// the io_uring backend: a ring has to return every queued open and statx with its own data
+// and result, stay usable for the next batch, and a walk through rings of any depth has to
+// report the same entries as getdents; skipped where the kernel refuses io_uring
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "../search.hpp"
+#include "../uring.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path, size_t size) {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    std::string bytes(size, 'x');
+    if (write(fd, bytes.data(), bytes.size()) < 0) {
+        bytes.clear();
+    }
+    close(fd);
+}
+
+std::set<std::string> walk(const fs::path& root, Backend backend, unsigned threads, unsigned uringDepth) {
+    SearchOptions options;
+    options.root = root.native();
+    options.filenames = {"*"};
+    options.recursive = true;
+    options.backend = backend;
+    options.threads = threads;
+    options.uringDepth = uringDepth;
+    std::set<std::string> paths;
+    std::mutex lock;
+    search(options, [&](const SearchResult& result) {
+        std::lock_guard<std::mutex> guard(lock);
+        paths.insert(std::string(result.path()));
+    });
+    return paths;
+}
+
+} // namespace
+
+int main() {
+    std::unique_ptr<Uring> ring = Uring::create(8);
+    if (!ring) {
+        std::cout << "uring_test: io_uring is not available, skipped\n";
+        return 0;
+    }
+    char pattern[] = "/tmp/myfind-uring-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "uring_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    writeFile(top / "a" / "small", 10);
+    writeFile(top / "b" / "large", 5000);
+    CHECK(ring->depth() >= 8);
+
+    // opens and stats in one batch, each result with its data
+    int directory = open(top.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct statx small, large;
+    CHECK(ring->queueOpen(directory, "a", O_RDONLY | O_DIRECTORY | O_CLOEXEC, 1));
+    CHECK(ring->queueOpen(directory, "missing", O_RDONLY | O_CLOEXEC, 2));
+    CHECK(ring->queueStatx(directory, "a/small", 0, STATX_SIZE, &small, 3));
+    CHECK(ring->queueStatx(directory, "b/large", 0, STATX_SIZE, &large, 4));
+    CHECK(ring->queued() == 4);
+    std::map<uint64_t, int> results;
+    CHECK(ring->submitAndWait([&](uint64_t data, int result) { results[data] = result; }) == 0);
+    CHECK(ring->queued() == 0);
+    CHECK(results.size() == 4);
+    CHECK(results[1] >= 0);
+    CHECK(results[2] == -ENOENT);
+    CHECK(results[3] == 0 && small.stx_size == 10);
+    CHECK(results[4] == 0 && large.stx_size == 5000);
+    if (results[1] >= 0) {
+        close(results[1]);
+    }
+
+    // a full ring refuses more, and is usable again once the batch is done
+    unsigned queued = 0;
+    while (ring->queueOpen(directory, "b", O_RDONLY | O_DIRECTORY | O_CLOEXEC, queued)) {
+        ++queued;
+    }
+    CHECK(queued == ring->depth());
+    std::set<uint64_t> done;
+    CHECK(ring->submitAndWait([&](uint64_t data, int result) {
+        done.insert(data);
+        if (result >= 0) {
+            close(result);
+        }
+    }) == 0);
+    CHECK(done.size() == queued);
+    results.clear();
+    CHECK(ring->queueStatx(directory, "b/large", 0, STATX_SIZE, &large, 7));
+    CHECK(ring->submitAndWait([&](uint64_t data, int result) { results[data] = result; }) == 0);
+    CHECK(results.size() == 1 && results[7] == 0);
+    close(directory);
+
+    // walks with submissions of one operation up to larger than a directory
+    for (int i = 0; i < 40; ++i) {
+        fs::create_directories(top / "wide" / ("dir" + std::to_string(i)) / "sub");
+        writeFile(top / "wide" / ("dir" + std::to_string(i)) / "file", 0);
+    }
+    const std::set<std::string> expected = walk(top, Backend::Getdents, 1, 64);
+    for (unsigned depth : {1u, 2u, 3u, 64u}) {
+        for (unsigned threads : {1u, 4u}) {
+            CHECK_CASE(walk(top, Backend::Uring, threads, depth) == expected,
+                       "depth " + std::to_string(depth) + ", " + std::to_string(threads) + " threads");
+        }
+    }
+
+    fs::remove_all(top);
+    return finish("uring_test");
+}
@@ -0,0 +1,281 @@
+// the walker: a generated temporary tree has to be reported entry for entry like
+// std::filesystem sees it, with one or many threads and on every backend, and no entry
+// may be reported twice; -L has to read every directory once however many links lead there
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "../index.hpp"
+#include "../search.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path) {
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// levels of directories below directory, each with three subdirectories and four files
+void makeTree(const fs::path& directory, int levels) {
+    for (int i = 0; i < 4; ++i) {
+        writeFile(directory / ("file" + std::to_string(i) + (i % 2 == 0 ? ".c" : ".h")));
+    }
+    if (levels > 0) {
+        for (int i = 0; i < 3; ++i) {
+            makeTree(directory / ("dir" + std::to_string(i)), levels - 1);
+        }
+    }
+}
+
+// every match of a search, relative to options.root, in the order it was reported
+struct Walked {
+    std::vector<std::string> paths;
+    std::set<unsigned> workers;
+    SearchSummary summary;
+};
+
+Walked walk(const SearchOptions& options) {
+    Walked walked;
+    std::mutex lock;
+    walked.summary = search(options, [&](const SearchResult& result) {
+        std::lock_guard<std::mutex> guard(lock);
+        walked.paths.push_back(fs::path(std::string(result.path())).lexically_relative(options.root).native());
+        walked.workers.insert(result.worker);
+    });
+    return walked;
+}
+
+// the entries of everything a search with these depth limits and prune rules reports: pruned
+// directories themselves are, nothing below them is
+std::set<std::string> expect(const std::set<std::string>& everything, int minDepth, int maxDepth,
+                             const std::set<std::string>& prunedNames, const std::set<std::string>& prunedPaths) {
+    std::set<std::string> paths;
+    for (const std::string& path : everything) {
+        int depth = 1;
+        bool pruned = false;
+        for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            ++depth;
+            const std::string ancestor = path.substr(0, slash);
+            pruned = pruned || prunedNames.count(fs::path(ancestor).filename().native()) > 0 ||
+                     prunedPaths.count(ancestor) > 0;
+        }
+        if (depth >= minDepth && (maxDepth == 0 || depth <= maxDepth) && !pruned) {
+            paths.insert(path);
+        }
+    }
+    return paths;
+}
+
+std::set<std::string> asSet(const std::vector<std::string>& paths) {
+    return std::set<std::string>(paths.begin(), paths.end());
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/myfind-walk-test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "walk_test: cannot create a temporary directory\n";
+        return 1;
+    }
+    const fs::path top = pattern;
+    const fs::path tree = top / "tree";
+    makeTree(tree, 3);
+
+    std::set<std::string> everything;
+    std::set<std::string> sources;
+    for (const auto& entry : fs::recursive_directory_iterator(tree)) {
+        std::string path = entry.path().lexically_relative(tree).native();
+        everything.insert(path);
+        if (entry.path().extension() == ".c") {
+            sources.insert(path);
+        }
+    }
+
+    SearchOptions options;
+    options.root = tree.native();
+    options.filenames = {"*"};
+    options.recursive = true;
+
+    // -j: every entry exactly once, whatever the number of threads and the backend
+    const std::vector<std::pair<Backend, std::string>> backends = {
+        {Backend::Getdents, "getdents"}, {Backend::Uring, "uring"}, {Backend::Filesystem, "std"}};
+    for (const auto& backend : backends) {
+        for (unsigned threads : {1u, 2u, 3u, 8u}) {
+            options.backend = backend.first;
+            options.threads = threads;
+            Walked walked = walk(options);
+            std::string description = backend.second + ", " + std::to_string(threads) + " threads";
+            CHECK_CASE(asSet(walked.paths) == everything, description);
+            CHECK_CASE(walked.paths.size() == everything.size(), description + ", nothing twice");
+            CHECK_CASE(*walked.workers.rbegin() < threads, description + ", worker numbers");
+            CHECK_CASE(walked.summary.statistics.workers.size() == threads, description + ", statistics");
+        }
+    }
+
+    // several filenames in one walk, each counted on its own
+    options.backend = Backend::Getdents;
+    options.threads = 4;
+    options.filenames = {"*.c", "file1.h", "missing"};
+    Walked walked = walk(options);
+    CHECK(walked.summary.hits == std::vector<size_t>({sources.size(), 40, 0}));
+    options.recursive = false;
+    walked = walk(options);
+    CHECK(walked.summary.hits == std::vector<size_t>({2, 1, 0}));
+
+    // --order=bfs: with one thread no entry is reported before a shallower one, unlike
+    // depth-first, and the first hit is the shallowest
+    const auto depth = [](const std::string& path) { return std::count(path.begin(), path.end(), '/'); };
+    options.filenames = {"*"};
+    options.recursive = true;
+    options.threads = 1;
+    for (const auto& backend : backends) {
+        options.backend = backend.first;
+        options.order = Order::BreadthFirst;
+        walked = walk(options);
+        CHECK_CASE(std::is_sorted(walked.paths.begin(), walked.paths.end(),
+                                  [&](const std::string& a, const std::string& b) { return depth(a) < depth(b); }),
+                   backend.second + ", bfs");
+        if (backend.first == Backend::Uring) {
+            continue; // opens a batch of siblings at once, so a small tree comes out level by level
+        }
+        options.order = Order::DepthFirst;
+        walked = walk(options);
+        CHECK_CASE(!std::is_sorted(walked.paths.begin(), walked.paths.end(),
+                                   [&](const std::string& a, const std::string& b) { return depth(a) < depth(b); }),
+                   backend.second + ", dfs");
+    }
+    options.backend = Backend::Getdents;
+    options.order = Order::BreadthFirst;
+    options.threads = 4;
+    CHECK(asSet(walk(options).paths) == everything);
+    options.filenames = {"file3.h"};
+    options.hitLimit = 1;
+    options.threads = 1;
+    walked = walk(options);
+    CHECK(walked.paths == std::vector<std::string>({"file3.h"}));
+    options.hitLimit = 0;
+    options.order = Order::DepthFirst;
+
+    // --mindepth, --maxdepth and --prune, walked and answered from an index
+    struct Limits {
+        int minDepth;
+        int maxDepth;
+        std::vector<std::string> prune;
+        std::set<std::string> prunedNames;
+        std::set<std::string> prunedPaths;
+    };
+    const std::vector<Limits> limits = {
+        {0, 1, {}, {}, {}},
+        {2, 0, {}, {}, {}},
+        {2, 3, {}, {}, {}},
+        {4, 4, {}, {}, {}},
+        {0, 0, {"dir1"}, {"dir1"}, {}},
+        {0, 0, {"d*2", "dir0"}, {"dir2", "dir0"}, {}},
+        {0, 0, {tree.native() + "/dir0/dir1"}, {}, {"dir0/dir1"}},
+        {0, 0, {"*/dir0/dir1"}, {}, {"dir0/dir1", "dir0/dir0/dir1", "dir1/dir0/dir1", "dir2/dir0/dir1"}},
+        {0, 0, {"DIR1"}, {}, {}}, // case matters without -i
+        {2, 3, {"dir2", tree.native() + "/dir1/d?r1"}, {"dir2"}, {"dir1/dir1"}},
+    };
+    const std::string indexFile = (top / "tree.idx").native();
+    buildIndex(indexFile, tree.native(), 1, Backend::Getdents);
+    options.filenames = {"*"};
+    for (const auto& limit : limits) {
+        std::string description = std::to_string(limit.minDepth) + ".." + std::to_string(limit.maxDepth);
+        for (const std::string& rule : limit.prune) {
+            description += " prune " + rule;
+        }
+        const std::set<std::string> expected =
+            expect(everything, limit.minDepth, limit.maxDepth, limit.prunedNames, limit.prunedPaths);
+        options.minDepth = limit.minDepth;
+        options.maxDepth = limit.maxDepth;
+        options.prunePatterns = limit.prune;
+        for (const auto& backend : backends) {
+            options.backend = backend.first;
+            CHECK_CASE(asSet(walk(options).paths) == expected, description + ", " + backend.second);
+        }
+        options.indexFile = indexFile;
+        CHECK_CASE(asSet(walk(options).paths) == expected, description + ", index");
+        options.indexFile.clear();
+    }
+    options.minDepth = options.maxDepth = 0;
+    options.prunePatterns.clear();
+
+    // -L: links to directories are followed, every directory is read once however many
+    // links lead to it, and a link loop ends; which path a directory is reported under
+    // depends on which link is read first, so only the counts are checked
+    const fs::path links = top / "links";
+    writeFile(links / "real" / "deep" / "a.txt");
+    writeFile(top / "outside" / "o.txt");
+    fs::create_directory_symlink("real", links / "alias");
+    fs::create_directory_symlink("../real", links / "real" / "deep" / "back");
+    fs::create_directory_symlink(".", links / "loop");
+    fs::create_directory_symlink("../outside", links / "out");
+    fs::create_symlink("real/deep/a.txt", links / "file-link");
+    fs::create_symlink("missing", links / "dangling");
+    SearchOptions linkOptions;
+    linkOptions.root = links.native();
+    linkOptions.filenames = {"a.txt", "o.txt", "deep", "*link*", "dangling"};
+    linkOptions.recursive = true;
+    for (const auto& backend : backends) {
+        for (unsigned threads : {1u, 4u}) {
+            const std::string description = backend.second + ", " + std::to_string(threads) + " threads";
+            linkOptions.backend = backend.first;
+            linkOptions.threads = threads;
+            linkOptions.followSymlinks = false;
+            CHECK_CASE(walk(linkOptions).summary.hits == std::vector<size_t>({1, 0, 1, 1, 1}), description);
+            linkOptions.followSymlinks = true;
+            Walked followed = walk(linkOptions);
+            CHECK_CASE(followed.summary.hits == std::vector<size_t>({1, 1, 1, 1, 1}), description + ", -L");
+            CHECK_CASE(asSet(followed.paths).count("out/o.txt") == 1, description + ", -L outside the tree");
+        }
+    }
+
+    // -xdev: a directory on another filesystem is reported but not read, here one in
+    // /dev/shm reached through a link; --device-jobs must not lose any entry
+    char shmPattern[] = "/dev/shm/myfind-walk-test.XXXXXX";
+    struct stat topStatus, shmStatus;
+    if (mkdtemp(shmPattern) != nullptr) {
+        writeFile(fs::path(shmPattern) / "x.txt");
+        fs::create_directory_symlink(shmPattern, links / "shm");
+        if (stat(shmPattern, &shmStatus) == 0 && stat(links.c_str(), &topStatus) == 0 &&
+            shmStatus.st_dev != topStatus.st_dev) {
+            linkOptions.filenames = {"x.txt", "shm", "a.txt"};
+            linkOptions.followSymlinks = true;
+            for (const auto& backend : backends) {
+                linkOptions.backend = backend.first;
+                linkOptions.sameDevice = false;
+                CHECK_CASE(walk(linkOptions).summary.hits == std::vector<size_t>({1, 1, 1}), backend.second);
+                linkOptions.sameDevice = true;
+                CHECK_CASE(walk(linkOptions).summary.hits == std::vector<size_t>({0, 1, 1}), backend.second + ", -xdev");
+            }
+            linkOptions.sameDevice = false;
+        }
+        fs::remove_all(shmPattern);
+    }
+    options.backend = Backend::Getdents;
+    options.threads = 4;
+    options.deviceJobs = 1;
+    CHECK(asSet(walk(options).paths) == everything);
+    options.deviceJobsFor = {{tree.native(), 2}};
+    CHECK(asSet(walk(options).paths) == everything);
+    options.deviceJobs = 0;
+    options.deviceJobsFor.clear();
+
+    fs::remove_all(top);
+    return finish("walk_test");
+}
@@ -0,0 +1,95 @@
+#include "trace.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "output.hpp"
+
+namespace {
+
+// microseconds with three decimals, the unit of "ts"
+void appendMicroseconds(std::string& out, int64_t nanoseconds) {
+    out += std::to_string(nanoseconds / 1000);
+    int64_t fraction = nanoseconds % 1000;
+    out += '.';
+    out += static_cast<char>('0' + fraction / 100);
+    out += static_cast<char>('0' + fraction / 10 % 10);
+    out += static_cast<char>('0' + fraction % 10);
+}
+
+bool writeFile(int fd, const std::string& text) {
+    const char* data = text.data();
+    size_t size = text.size();
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder(unsigned threads) : start(now()), buffers(threads == 0 ? 1 : threads) {}
+
+int64_t TraceRecorder::now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void TraceRecorder::record(unsigned worker, std::string_view path, int depth, uint64_t entries, int64_t begin, int64_t end) {
+    Buffer& buffer = buffers[worker];
+    buffer.events.push_back(Event{buffer.paths.size(), path.size(), depth, entries, begin - start, end - start});
+    buffer.paths.append(path);
+}
+
+bool TraceRecorder::write(const std::string& file, int pid) const {
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    const std::string process = std::to_string(pid);
+    std::string text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool ok = true;
+    for (size_t worker = 0; worker < buffers.size() && ok; ++worker) {
+        const std::string thread = std::to_string(worker);
+        // names the worker's track
+        text += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + process + ",\"tid\":" + thread
+                + ",\"args\":{\"name\":\"worker " + thread + "\"}}";
+        for (const Event& event : buffers[worker].events) {
+            std::string_view path(buffers[worker].paths.data() + event.pathOffset, event.pathSize);
+            text += ",\n{\"name\":";
+            appendJsonString(text, path);
+            text += ",\"cat\":\"directory\",\"ph\":\"B\",\"pid\":" + process + ",\"tid\":" + thread + ",\"ts\":";
+            appendMicroseconds(text, event.begin);
+            text += ",\"args\":{\"path\":";
+            appendJsonString(text, path);
+            text += ",\"depth\":" + std::to_string(event.depth) + "}},\n{\"ph\":\"E\",\"pid\":" + process
+                    + ",\"tid\":" + thread + ",\"ts\":";
+            appendMicroseconds(text, event.end);
+            text += ",\"args\":{\"entries\":" + std::to_string(event.entries) + "}}";
+            // written in pieces, a trace of a large tree does not have to fit in memory twice
+            if (text.size() >= 1024 * 1024) {
+                ok = writeFile(fd, text);
+                text.clear();
+            }
+        }
+        text += worker + 1 < buffers.size() ? ",\n" : "\n";
+    }
+    text += "]}\n";
+    ok = ok && writeFile(fd, text);
+    int error = errno;
+    close(fd);
+    errno = error;
+    return ok;
+}
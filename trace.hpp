@@ -0,0 +1,44 @@
+#ifndef MYFIND_TRACE_HPP
+#define MYFIND_TRACE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --trace: one event per directory visit, written as Chrome trace-event JSON that
+// chrome://tracing and Perfetto open as a timeline with one track per worker.
+// Every worker appends to its own buffer, so recording takes no lock; the buffers are
+// only read once the walk is over
+class TraceRecorder {
+public:
+    explicit TraceRecorder(unsigned threads);
+
+    // nanoseconds on the clock record() expects
+    static int64_t now();
+    // worker visited path at depth between begin and end, reading entries entries
+    void record(unsigned worker, std::string_view path, int depth, uint64_t entries, int64_t begin, int64_t end);
+    // a begin and an end event per visit, times relative to the recorder's creation;
+    // false with errno set if file cannot be written
+    bool write(const std::string& file, int pid) const;
+
+private:
+    struct Event {
+        size_t pathOffset; // into the buffer's paths
+        size_t pathSize;
+        int depth;
+        uint64_t entries;
+        int64_t begin;
+        int64_t end;
+    };
+
+    struct alignas(64) Buffer {
+        std::vector<Event> events;
+        std::string paths; // all paths back to back, one allocation for many events
+    };
+
+    int64_t start;
+    std::vector<Buffer> buffers; // one per worker
+};
+
+#endif
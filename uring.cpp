@@ -0,0 +1,128 @@
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::unique_ptr<Uring> Uring::create(unsigned depth) {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Uring> ring(new Uring());
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+    }
+
+    void* sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->sqRing = sqRing;
+    void* cqRing = sqRing;
+    if (!singleMap) {
+        cqRing = mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return nullptr;
+        }
+    }
+    ring->cqRing = cqRing;
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return ring;
+#else
+    (void)depth;
+    return nullptr;
+#endif
+}
+
+Uring::~Uring() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != nullptr) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+io_uring_sqe* Uring::nextEntry() {
+    if (pending == entries) {
+        return nullptr;
+    }
+    // only this thread writes the tail, the kernel reads it once the entry is complete
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    ++pending;
+    return sqe;
+}
+
+bool Uring::queueOpen(int directoryFd, const char* path, int flags, uint64_t data) {
+    io_uring_sqe* sqe = nextEntry();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = directoryFd;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->open_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = data;
+    __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool Uring::queueStatx(int directoryFd, const char* path, int flags, unsigned mask, struct statx* result, uint64_t data) {
+    io_uring_sqe* sqe = nextEntry();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = directoryFd;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->len = mask;
+    sqe->addr2 = reinterpret_cast<uint64_t>(result);
+    sqe->statx_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = data;
+    __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+int Uring::enter(unsigned count, unsigned wait) {
+    long result = syscall(__NR_io_uring_enter, fd, count, wait, IORING_ENTER_GETEVENTS, nullptr, 0);
+    return result < 0 ? -errno : static_cast<int>(result);
+}
@@ -0,0 +1,101 @@
+#ifndef MYFIND_URING_HPP
+#define MYFIND_URING_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <linux/io_uring.h>
+#include <sys/stat.h>
+
+// minimal io_uring on raw syscalls (no liburing needed): operations are queued, submitted
+// together and waited for, so one io_uring_enter covers a whole batch of opens or stats.
+// One ring per thread, it is not safe to share
+class Uring {
+public:
+    // ring with room for depth operations, nullptr if the kernel or a seccomp filter refuses io_uring
+    static std::unique_ptr<Uring> create(unsigned depth);
+    ~Uring();
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    unsigned depth() const { return entries; }
+    unsigned queued() const { return pending; }
+
+    // queue an openat / statx, false if the ring is full; data comes back with the result
+    bool queueOpen(int directoryFd, const char* path, int flags, uint64_t data);
+    bool queueStatx(int directoryFd, const char* path, int flags, unsigned mask, struct statx* result, uint64_t data);
+
+    // submit everything queued and wait until all of it completed, done(data, result) is called
+    // for every operation with its return value or -errno. Returns 0, or -errno once
+    // io_uring_enter fails for good: operations without a done() call then have no result,
+    // the caller does them without the ring, which must not be used again
+    template <typename Done>
+    int submitAndWait(Done&& done) {
+        unsigned remaining = pending;   // queued and not completed
+        unsigned unsubmitted = pending; // queued and not taken by the kernel yet
+        pending = 0;
+        while (remaining > 0) {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                done(cqe.user_data, cqe.res);
+                --remaining;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            if (remaining == 0) {
+                break;
+            }
+
+            const unsigned inFlight = remaining - unsubmitted;
+            int result = enter(unsubmitted, 1);
+            if (result >= 0) {
+                // the kernel may take fewer entries than offered, the rest go in the next round
+                unsubmitted -= std::min<unsigned>(result, unsubmitted);
+                continue;
+            }
+            if (result == -EINTR) {
+                continue;
+            }
+            if ((result == -EAGAIN || result == -EBUSY) && inFlight > 0) {
+                // out of memory for new requests or completions not reaped yet: wait for one,
+                // reap it and offer the same entries again
+                result = enter(0, 1);
+                if (result >= 0 || result == -EINTR) {
+                    continue;
+                }
+            }
+            return result;
+        }
+        return 0;
+    }
+
+private:
+    Uring() = default;
+    io_uring_sqe* nextEntry();
+    // io_uring_enter with count new entries, waiting for at least wait completions; the
+    // number of entries the kernel took or -errno
+    int enter(unsigned count, unsigned wait);
+
+    int fd = -1;
+    unsigned entries = 0;
+    unsigned pending = 0; // queued but not submitted
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr; // same mapping as sqRing with IORING_FEAT_SINGLE_MMAP
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+};
+
+#endif
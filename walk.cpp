@@ -0,0 +1,716 @@
+#include "walk.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+#include "ignore.hpp"
+#include "trace.hpp"
+#include "uring.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// record layout returned by getdents64, glibc does not export it before 2.30
+struct LinuxDirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// large enough that most directories are read with a single syscall
+constexpr size_t direntBufferSize = 256 * 1024;
+// largest getdents64 record: header, 255 byte name and its terminator, 8 byte aligned
+constexpr size_t maximumDirentSize = (offsetof(LinuxDirent64, d_name) + 256 + 7) & ~size_t(7);
+
+// breadth-first: past this many pending directories a thread goes depth-first until the
+// frontier shrinks again, a wide tree would otherwise queue most of its directories at once
+constexpr size_t maximumFrontier = 16384;
+
+// device limits: pending directories looked at from each end of a deque for one on a device
+// with a free worker
+constexpr size_t maximumDeviceScan = 16;
+
+// uring backend: own pending directories opened with one submission; more would leave the
+// other threads less to steal
+constexpr size_t maximumOpenBatch = 16;
+
+std::string joinPath(const std::string& directory, std::string_view name) {
+    std::string path;
+    path.reserve(directory.size() + 1 + name.size());
+    path += directory;
+    if (path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+// the entry's d_type does not tell whether to descend: the filesystem does not fill it in,
+// or -L has to find out where a symlink points
+bool needsLookup(const LinuxDirent64* dirent, bool followSymlinks) {
+    if (dirent->d_type != DT_UNKNOWN && !(dirent->d_type == DT_LNK && followSymlinks)) {
+        return false;
+    }
+    std::string_view name(dirent->d_name);
+    return name != "." && name != "..";
+}
+
+double threadCpuSeconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+}
+
+DirHandle::DirHandle(int fd, std::atomic<size_t>* openCount) : fd(fd), openCount(openCount) {
+    if (openCount != nullptr) {
+        openCount->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+DirHandle::~DirHandle() {
+    close(fd);
+    if (openCount != nullptr) {
+        openCount->fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+namespace {
+
+// 64 bit finalizer of MurmurHash3, spreads (device, inode) over shards and slots
+uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+}
+
+bool VisitedDirectories::insert(uint64_t device, uint64_t inode) {
+    const uint64_t hash = mix(inode ^ mix(device));
+    Shard& shard = shards[hash >> (64 - shardBits)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    // keep the table at most half full so probe sequences stay short
+    if ((shard.used + 1) * 2 > shard.slots.size()) {
+        std::vector<Slot> old(std::max<size_t>(64, shard.slots.size() * 2), Slot{0, 0, false});
+        old.swap(shard.slots);
+        const size_t mask = shard.slots.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.used) {
+                size_t i = mix(slot.inode ^ mix(slot.device)) & mask;
+                while (shard.slots[i].used) {
+                    i = (i + 1) & mask;
+                }
+                shard.slots[i] = slot;
+            }
+        }
+    }
+
+    const size_t mask = shard.slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = shard.slots[i];
+        if (!slot.used) {
+            slot = Slot{device, inode, true};
+            ++shard.used;
+            return true;
+        }
+        if (slot.device == device && slot.inode == inode) {
+            return false;
+        }
+    }
+}
+
+unsigned DeviceLimiter::limitFor(uint64_t device) const {
+    for (const auto& entry : overrides) {
+        if (entry.first == device) {
+            return entry.second;
+        }
+    }
+    return defaultLimit;
+}
+
+DeviceLimiter::Slot* DeviceLimiter::acquire(uint64_t device) {
+    const uint64_t key = device + 1;
+    Slot* slot = &overflow;
+    for (size_t n = 0, i = mix(device) % slotCount; n < slotCount; ++n, i = (i + 1) % slotCount) {
+        uint64_t current = slots[i].key.load(std::memory_order_acquire);
+        if (current == 0 && slots[i].key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+            current = key;
+        }
+        if (current == key) {
+            slot = &slots[i];
+            break;
+        }
+    }
+    if (slot == &overflow) {
+        overflow.active.fetch_add(1, std::memory_order_acquire);
+        return slot;
+    }
+
+    const unsigned limit = limitFor(device);
+    unsigned active = slot->active.load(std::memory_order_relaxed);
+    do {
+        if (limit > 0 && active >= limit) {
+            return nullptr;
+        }
+    } while (!slot->active.compare_exchange_weak(active, active + 1, std::memory_order_acquire));
+    return slot;
+}
+
+ParallelWalker::ParallelWalker(unsigned threads, bool recursive, Backend backend, Visitor visitor, ErrorHandler onError)
+    : threadCount(threads == 0 ? 1 : threads), recursive(recursive), backend(backend),
+      visitor(std::move(visitor)), onError(std::move(onError)) {
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    if (backend != Backend::Filesystem) {
+        direntBuffers.resize(threadCount);
+    }
+    deviceSlots.resize(threadCount, nullptr);
+    counters.resize(threadCount);
+    struct rlimit limit;
+    handleBudget = getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY ? limit.rlim_cur / 2 : 4096;
+}
+
+ParallelWalker::~ParallelWalker() = default;
+
+void ParallelWalker::run(const std::string& root) {
+    struct stat status;
+    if ((sameDevice || devices.limited()) && stat(root.c_str(), &status) == 0) {
+        rootDevice = status.st_dev;
+    }
+    if (backend == Backend::Uring && urings.empty()) {
+        urings.resize(threadCount);
+        for (auto& state : urings) {
+            state.ring = Uring::create(uringDepth);
+            if (!state.ring) {
+                // old kernel, or io_uring disabled by sysctl or seccomp
+                urings.clear();
+                backend = Backend::Getdents;
+                break;
+            }
+            state.status.resize(state.ring->depth());
+        }
+    }
+    pending = 1;
+    queues[0]->tasks.push_back(DirTask{root, 0, nullptr, 0, ignoreRoot, rootDevice});
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i) {
+        threads.emplace_back(&ParallelWalker::work, this, i);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // after a cancel: release the parent directories the remaining tasks keep open
+    for (auto& queue : queues) {
+        queue->tasks.clear();
+    }
+}
+
+// own deque is used as a stack (depth-first, keeps the working set small) or as a queue
+// (breadth-first), victims are robbed from the front where the shallowest and largest subtrees are
+bool ParallelWalker::takeTask(unsigned worker, DirTask& task) {
+    {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        bool fromFront = order == Order::BreadthFirst && own.tasks.size() <= maximumFrontier;
+        if (takeFrom(own.tasks, fromFront, worker, task)) {
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < threadCount; ++i) {
+        WorkQueue& victim = *queues[(worker + i) % threadCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (takeFrom(victim.tasks, true, worker, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParallelWalker::takeFrom(std::deque<DirTask>& tasks, bool fromFront, unsigned worker, DirTask& task) {
+    if (tasks.empty()) {
+        return false;
+    }
+    if (!devices.limited()) {
+        if (fromFront) {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        } else {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        }
+        return true;
+    }
+
+    // a few tasks deep is enough to get past a run of directories on a full device
+    const size_t scan = std::min(tasks.size(), maximumDeviceScan);
+    for (size_t k = 0; k < scan; ++k) {
+        size_t i = fromFront ? k : tasks.size() - 1 - k;
+        if (DeviceLimiter::Slot* slot = devices.acquire(tasks[i].device)) {
+            deviceSlots[worker] = slot;
+            task = std::move(tasks[i]);
+            tasks.erase(tasks.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ParallelWalker::work(unsigned worker) {
+    const auto wallStart = std::chrono::steady_clock::now();
+    const double cpuStart = threadCpuSeconds();
+    DirTask task;
+
+    while (pending.load(std::memory_order_acquire) > 0 && !isCancelled()) {
+        // read before looking for a task, so a task queued after a failed look still wakes us
+        const uint64_t seen = wakeups.load();
+        if (!takeTask(worker, task)) {
+            // other threads are still reading directories that may produce more work
+            std::unique_lock<std::mutex> guard(idleLock);
+            ++idleWorkers;
+            idleChanged.wait(guard, [&] {
+                return wakeups.load() != seen || pending.load() == 0 || isCancelled();
+            });
+            --idleWorkers;
+            continue;
+        }
+        if (backend == Backend::Uring && urings[worker].ring) {
+            visitBatch(worker, task);
+            continue;
+        }
+        visitDirectory(worker, task, backend == Backend::Getdents ? openDirectory(task) : -1);
+        finishTask(worker);
+    }
+
+    WalkStatistics& statistics = counters[worker];
+    statistics.wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    statistics.cpuSeconds += threadCpuSeconds() - cpuStart;
+}
+
+void ParallelWalker::finishTask(unsigned worker) {
+    bool released = deviceSlots[worker] != nullptr;
+    if (released) {
+        devices.release(deviceSlots[worker]);
+        deviceSlots[worker] = nullptr;
+    }
+    // the last task wakes everyone to return, a free device slot may unblock a queued task
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1 || released) {
+        wakeIdle();
+    }
+}
+
+void ParallelWalker::wakeIdle() {
+    wakeups.fetch_add(1);
+    if (idleWorkers.load() > 0) {
+        // taking the lock orders this after a worker that is between its check and its wait
+        std::lock_guard<std::mutex> guard(idleLock);
+        idleChanged.notify_all();
+    }
+}
+
+void ParallelWalker::cancel() {
+    cancelled.store(true, std::memory_order_relaxed);
+    wakeIdle();
+}
+
+void ParallelWalker::visitBatch(unsigned worker, DirTask& task) {
+    Uring& ring = *urings[worker].ring;
+    std::vector<DirTask> batch;
+    batch.push_back(std::move(task));
+    // with device limits each task holds its device's slot, so those are read one at a time
+    if (!devices.limited()) {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        bool fromFront = order == Order::BreadthFirst && own.tasks.size() <= maximumFrontier;
+        const size_t limit = std::min<size_t>(maximumOpenBatch, ring.depth());
+        DirTask next;
+        while (batch.size() < limit && takeFrom(own.tasks, fromFront, worker, next)) {
+            batch.push_back(std::move(next));
+        }
+    }
+
+    constexpr int notOpened = INT_MIN;
+    std::vector<int> fds(batch.size(), notOpened);
+    if (batch.size() == 1) {
+        fds[0] = openDirectory(batch[0]); // nothing to batch, a plain syscall is cheaper
+    } else {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const DirTask& pendingTask = batch[i];
+            int directoryFd = pendingTask.parent ? pendingTask.parent->fd : AT_FDCWD;
+            const char* path = pendingTask.path.c_str() + (pendingTask.parent ? pendingTask.nameOffset : 0);
+            ring.queueOpen(directoryFd, path, openFlags(pendingTask), i);
+        }
+        int failed = ring.submitAndWait([&](uint64_t i, int result) {
+            // -EINVAL: the kernel has no IORING_OP_OPENAT (before 5.6)
+            fds[i] = result == -EINVAL ? openDirectory(batch[i]) : result;
+        });
+        if (failed != 0) {
+            // io_uring gave up: open what it did not, this worker reads synchronously from now on
+            urings[worker].ring.reset();
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (fds[i] == notOpened) {
+                    fds[i] = openDirectory(batch[i]);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (isCancelled()) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        } else {
+            visitDirectory(worker, batch[i], fds[i]);
+        }
+        finishTask(worker);
+    }
+}
+
+void ParallelWalker::visitDirectory(unsigned worker, const DirTask& task, int fd) {
+    if (trace == nullptr) {
+        readDirectory(worker, task, fd);
+        return;
+    }
+    // the entry count comes from the worker's counter, so tracing adds nothing to the read itself
+    const uint64_t entries = counters[worker].entries;
+    const int64_t begin = TraceRecorder::now();
+    readDirectory(worker, task, fd);
+    trace->record(worker, task.path, task.depth, counters[worker].entries - entries, begin, TraceRecorder::now());
+}
+
+void ParallelWalker::readDirectory(unsigned worker, const DirTask& task, int fd) {
+    std::vector<DirTask> subdirectories;
+
+    if (backend == Backend::Filesystem) {
+        readFilesystem(worker, task, subdirectories);
+    } else {
+        readGetdents(worker, task, fd, subdirectories);
+    }
+
+    if (subdirectories.empty() || isCancelled()) {
+        return;
+    }
+    // count the new tasks before they become visible so pending never drops to 0 early
+    pending.fetch_add(subdirectories.size(), std::memory_order_acq_rel);
+    WorkQueue& own = *queues[worker];
+    std::unique_lock<std::mutex> guard(own.lock);
+    for (auto& subdirectory : subdirectories) {
+        own.tasks.push_back(std::move(subdirectory));
+    }
+    guard.unlock();
+    wakeIdle();
+}
+
+bool ParallelWalker::descendInto(const DirTask& task, const std::string& path, std::string_view name) const {
+    if (!recursive || (maximumDepth > 0 && task.depth + 1 >= maximumDepth)) {
+        return false;
+    }
+    return !pruneFilter || !pruneFilter(path, name);
+}
+
+void ParallelWalker::addEntry(unsigned worker, const DirTask& task, std::string_view name, unsigned char type,
+                              const OpenDirectory& directory, std::vector<DirTask>& subdirectories) {
+    const bool isDirectory = type == DT_DIR;
+    ++counters[worker].entries;
+    if (directory.ignore && directory.ignore->ignored(task.path, name, isDirectory)) {
+        return;
+    }
+    if (task.depth + 1 >= minimumDepth) {
+        visitor(worker, task.path, WalkEntry{name, isDirectory, type, directory.handle ? directory.handle->fd : -1});
+    }
+    if (!isDirectory || !recursive) {
+        return;
+    }
+    std::string path = joinPath(task.path, name);
+    if (descendInto(task, path, name)) {
+        size_t nameOffset = path.size() - name.size();
+        bool keepParent = directory.handle && openHandles.load(std::memory_order_relaxed) < handleBudget;
+        subdirectories.push_back(DirTask{std::move(path), task.depth + 1, keepParent ? directory.handle : nullptr,
+                                         nameOffset, directory.ignore, directory.device});
+    }
+}
+
+const std::vector<CachedEntry>* ParallelWalker::cachedListing(unsigned worker, const DirTask& task, int fd) {
+    if (!directoryHook) {
+        return nullptr;
+    }
+    struct stat status;
+    ++counters[worker].statCalls;
+    int result = fd >= 0 ? fstat(fd, &status) : stat(task.path.c_str(), &status);
+    return result == 0 ? directoryHook(worker, task, status) : nullptr;
+}
+
+bool ParallelWalker::enterDirectory(unsigned worker, const DirTask& task, const struct stat& status) {
+    if (sameDevice && static_cast<uint64_t>(status.st_dev) != rootDevice) {
+        return false;
+    }
+    if (devices.limited() && static_cast<uint64_t>(status.st_dev) != task.device) {
+        // crossed a mount point: count this worker for the new device, or leave the
+        // directory to whichever worker finds that device with room later
+        devices.release(deviceSlots[worker]);
+        wakeIdle();
+        deviceSlots[worker] = devices.acquire(status.st_dev);
+        if (deviceSlots[worker] == nullptr) {
+            DirTask again = task;
+            again.device = status.st_dev;
+            pending.fetch_add(1, std::memory_order_acq_rel);
+            WorkQueue& own = *queues[worker];
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                own.tasks.push_front(std::move(again));
+            }
+            wakeIdle();
+            return false;
+        }
+    }
+    // checked last, a directory queued again is not visited yet
+    return !followSymlinks || visited.insert(status.st_dev, status.st_ino);
+}
+
+void ParallelWalker::readFilesystem(unsigned worker, const DirTask& task, std::vector<DirTask>& subdirectories) {
+    WalkStatistics& statistics = counters[worker];
+    OpenDirectory directory{nullptr, nullptr, task.device};
+    struct stat status;
+    statistics.statCalls += needsStatus();
+    if (needsStatus() && stat(task.path.c_str(), &status) == 0) {
+        if (!enterDirectory(worker, task, status)) {
+            return;
+        }
+        directory.device = status.st_dev;
+    }
+    // rules of this directory on top of those of the directories above
+    if (task.ignore) {
+        directory.ignore = IgnoreFrame::load(task.ignore, task.path, -1);
+    }
+
+    if (const auto* listing = cachedListing(worker, task, -1)) {
+        for (const auto& entry : *listing) {
+            if (isCancelled()) {
+                return;
+            }
+            addEntry(worker, task, entry.name, entry.isDirectory ? DT_DIR : DT_UNKNOWN, directory, subdirectories);
+        }
+        return;
+    }
+
+    try {
+        fs::directory_iterator entries(task.path, fs::directory_options::skip_permission_denied);
+        ++statistics.directories;
+        for (const auto& entry : entries) {
+            if (isCancelled()) {
+                return;
+            }
+            ++statistics.entries;
+            std::error_code error;
+            bool isDirectory = (followSymlinks || !entry.is_symlink(error)) && entry.is_directory(error);
+            const std::string& path = entry.path().native();
+            std::string_view name(path);
+            name.remove_prefix(path.size() - entry.path().filename().native().size());
+
+            if (directory.ignore && directory.ignore->ignored(task.path, name, isDirectory)) {
+                continue;
+            }
+            if (task.depth + 1 >= minimumDepth) {
+                visitor(worker, task.path, WalkEntry{name, isDirectory, static_cast<unsigned char>(isDirectory ? DT_DIR : DT_UNKNOWN), -1});
+            }
+            if (isDirectory && descendInto(task, path, name)) {
+                subdirectories.push_back(DirTask{path, task.depth + 1, nullptr, 0, directory.ignore, directory.device});
+            }
+        }
+    } catch (const std::exception& e) {
+        onError(task.path, e.what());
+    }
+}
+
+int ParallelWalker::openFlags(const DirTask& task) const {
+    // only the root itself may be a symlink, unless -L follows them all
+    const int noFollow = followSymlinks ? 0 : O_NOFOLLOW;
+    return O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.depth > 0 ? noFollow : 0);
+}
+
+int ParallelWalker::openDirectory(const DirTask& task) const {
+    int fd = task.parent ? openat(task.parent->fd, task.path.c_str() + task.nameOffset, openFlags(task))
+                         : open(task.path.c_str(), openFlags(task));
+    return fd < 0 ? -errno : fd;
+}
+
+void ParallelWalker::lookupTypes(unsigned worker, int fd, const char* entries, long bytes) {
+    UringWorker& state = urings[worker];
+    state.types.clear();
+    state.names.clear();
+    const int flags = followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+
+    // results land in status[] by ring slot, so a full ring is submitted before its slots are reused
+    auto collect = [&](uint64_t index, int result) {
+        if (result == -EINVAL) {
+            // the kernel has no IORING_OP_STATX (before 5.6)
+            struct stat status;
+            if (fstatat(fd, state.names[index], &status, flags) == 0) {
+                state.types[index] = IFTODT(status.st_mode);
+            }
+        } else if (result == 0) {
+            state.types[index] = IFTODT(state.status[index % state.status.size()].stx_mode);
+        }
+    };
+    // lookups before settled have their result
+    size_t settled = 0;
+    auto submit = [&] {
+        if (state.ring->submitAndWait(collect) == 0) {
+            settled = state.types.size();
+        } else {
+            // io_uring gave up: this worker looks up synchronously from now on
+            state.ring.reset();
+        }
+    };
+    for (long offset = 0; offset < bytes;) {
+        const auto* dirent = reinterpret_cast<const LinuxDirent64*>(entries + offset);
+        offset += dirent->d_reclen;
+        if (!needsLookup(dirent, followSymlinks)) {
+            continue;
+        }
+        size_t index = state.types.size();
+        if (state.ring && state.ring->queued() == state.ring->depth()) {
+            submit();
+        }
+        state.types.push_back(dirent->d_type);
+        state.names.push_back(dirent->d_name);
+        if (state.ring) {
+            state.ring->queueStatx(fd, dirent->d_name, flags, STATX_TYPE, &state.status[index % state.status.size()], index);
+        }
+        ++counters[worker].statCalls;
+    }
+    if (state.ring) {
+        submit();
+    }
+    for (size_t i = settled; i < state.types.size(); ++i) {
+        struct stat status;
+        if (fstatat(fd, state.names[i], &status, flags) == 0) {
+            state.types[i] = IFTODT(status.st_mode);
+        }
+    }
+}
+
+void ParallelWalker::readGetdents(unsigned worker, const DirTask& task, int fd, std::vector<DirTask>& subdirectories) {
+    WalkStatistics& statistics = counters[worker];
+    if (fd < 0) {
+        // same as skip_permission_denied, a directory that vanished is not an error either
+        if (fd == -EACCES || fd == -EPERM) {
+            ++statistics.permissionDenied;
+        } else if (fd != -ENOENT) {
+            onError(task.path, strerror(-fd));
+        }
+        return;
+    }
+    OpenDirectory directory{std::make_shared<DirHandle>(fd, &openHandles), nullptr, task.device};
+    struct stat status;
+    statistics.statCalls += needsStatus();
+    if (needsStatus() && fstat(fd, &status) == 0) {
+        if (!enterDirectory(worker, task, status)) {
+            return;
+        }
+        directory.device = status.st_dev;
+    }
+    ++statistics.directories;
+
+    if (const auto* listing = cachedListing(worker, task, fd)) {
+        if (task.ignore) {
+            directory.ignore = IgnoreFrame::load(task.ignore, task.path, fd);
+        }
+        for (const auto& entry : *listing) {
+            if (isCancelled()) {
+                return;
+            }
+            addEntry(worker, task, entry.name, entry.isDirectory ? DT_DIR : DT_UNKNOWN, directory, subdirectories);
+        }
+        return;
+    }
+
+    std::vector<char>& buffer = direntBuffers[worker];
+    if (buffer.empty()) {
+        buffer.resize(direntBufferSize);
+    }
+
+    for (;;) {
+        long bytes = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        ++statistics.directoryReads;
+        if (bytes < 0) {
+            onError(task.path, strerror(errno));
+            return;
+        }
+        if (bytes == 0) {
+            return;
+        }
+        statistics.direntBytes += bytes;
+        if (isCancelled()) {
+            return;
+        }
+
+        if (task.ignore && !directory.ignore) {
+            // a first read with room left for another record got the whole directory, then
+            // ignore files only have to be opened if they are listed; otherwise try right away
+            bool listed = bytes + maximumDirentSize > buffer.size();
+            for (long offset = 0; offset < bytes && !listed;) {
+                const auto* dirent = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+                offset += dirent->d_reclen;
+                listed = IgnoreFrame::isIgnoreFile(dirent->d_name);
+            }
+            directory.ignore = listed ? IgnoreFrame::load(task.ignore, task.path, fd) : task.ignore;
+        }
+        // there is no getdents opcode in io_uring, only the lookups of the chunk are batched
+        const bool batched = !urings.empty() && urings[worker].ring;
+        if (batched) {
+            lookupTypes(worker, fd, buffer.data(), bytes);
+        }
+        size_t lookups = 0;
+        for (long offset = 0; offset < bytes && !isCancelled();) {
+            const auto* dirent = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+            offset += dirent->d_reclen;
+
+            // a failed lookup leaves the type from getdents, so a dangling symlink stays a symlink
+            unsigned char type = dirent->d_type;
+            if (needsLookup(dirent, followSymlinks)) {
+                if (batched) {
+                    type = urings[worker].types[lookups++];
+                } else {
+                    struct stat status;
+                    ++statistics.statCalls;
+                    if (fstatat(fd, dirent->d_name, &status, followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW) == 0) {
+                        type = IFTODT(status.st_mode);
+                    }
+                }
+            }
+
+            std::string_view name(dirent->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            addEntry(worker, task, name, type, directory, subdirectories);
+        }
+    }
+}
@@ -0,0 +1,286 @@
+#ifndef MYFIND_WALK_HPP
+#define MYFIND_WALK_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+
+class IgnoreFrame;
+class TraceRecorder;
+class Uring;
+
+// how directories are read
+enum class Backend {
+    Filesystem, // std::filesystem::directory_iterator
+    Getdents,   // raw getdents64 into a reusable buffer, openat relative to the parent
+    Uring,      // getdents64, with opens and lookups batched through io_uring (Getdents if unavailable)
+};
+
+// order in which each thread takes its pending directories
+enum class Order {
+    DepthFirst,   // newest first, keeps the number of pending directories small
+    BreadthFirst, // oldest first, so shallow entries are reported before deep ones
+};
+
+// open directory file descriptor, closed once the last task referring to it is gone
+struct DirHandle {
+    int fd;
+    std::atomic<size_t>* openCount; // walker's count of open handles, may be nullptr
+
+    explicit DirHandle(int fd, std::atomic<size_t>* openCount = nullptr);
+    ~DirHandle();
+    DirHandle(const DirHandle&) = delete;
+    DirHandle& operator=(const DirHandle&) = delete;
+};
+
+// directory waiting to be read by one of the walker threads
+struct DirTask {
+    std::string path;
+    int depth;
+    // getdents backend: the parent directory, path is opened relative to it
+    std::shared_ptr<DirHandle> parent;
+    size_t nameOffset = 0; // start of the last path component
+    // --respect-ignore: ignore rules of the directories above, nullptr when not enabled
+    std::shared_ptr<const IgnoreFrame> ignore;
+    // -xdev / device limits: st_dev of the parent, which the directory is expected to share
+    uint64_t device = 0;
+};
+
+// directory entry as the visitor sees it
+struct WalkEntry {
+    std::string_view name;
+    bool isDirectory;   // the walker descends into it (with -L: a symlink to a directory)
+    unsigned char type; // DT_* of the entry, with -L of a symlink's target; DT_UNKNOWN if not known
+    int directoryFd;    // the directory being read, for *at() calls during the visit; -1 if not open
+};
+
+// counters of one walker thread, written only by that thread and read after the walk
+struct alignas(64) WalkStatistics {
+    uint64_t directories = 0;      // directories opened and read
+    uint64_t entries = 0;          // entries they listed, without "." and ".."
+    uint64_t statCalls = 0;        // stat, fstat, fstatat and statx calls of the walker
+    uint64_t directoryReads = 0;   // getdents64 calls
+    uint64_t direntBytes = 0;      // getdents64 data read
+    uint64_t permissionDenied = 0; // directories skipped because they could not be opened (EACCES, EPERM)
+    double wallSeconds = 0;        // time the thread spent in the walk, idle time included
+    double cpuSeconds = 0;         // CPU time of the thread during the walk
+};
+
+// directory entry remembered from an earlier walk
+struct CachedEntry {
+    std::string name;
+    bool isDirectory;
+};
+
+// directories already read while following symlinks, keyed by (st_dev, st_ino), so a
+// symlink loop or several links to one directory do not walk it again. Open addressing
+// with linear probing, split into shards with a lock each: workers only wait for each other
+// when they insert into the same shard at the same moment
+class VisitedDirectories {
+public:
+    // false if the directory was inserted before
+    bool insert(uint64_t device, uint64_t inode);
+
+private:
+    struct Slot {
+        uint64_t device;
+        uint64_t inode;
+        bool used;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex lock;
+        std::vector<Slot> slots; // size is a power of two
+        size_t used = 0;
+    };
+
+    static constexpr unsigned shardBits = 6;
+    Shard shards[1 << shardBits];
+};
+
+// how many workers may read directories of one device at the same time, so a slow network
+// mount cannot tie up every worker while directories on fast local disks wait. Devices get
+// their counters on first use from a fixed table, looked up without locks
+class DeviceLimiter {
+public:
+    struct Slot {
+        std::atomic<uint64_t> key{0}; // device + 1, 0 while unused
+        std::atomic<unsigned> active{0};
+    };
+
+    // limit for every device without its own, 0 for no limit
+    void setLimit(unsigned limit) { defaultLimit = limit; }
+    // limit for one device, set before the walk starts
+    void setLimit(uint64_t device, unsigned limit) { overrides.emplace_back(device, limit); }
+    bool limited() const { return defaultLimit > 0 || !overrides.empty(); }
+
+    // count one more worker on device, nullptr if it already has as many as allowed
+    Slot* acquire(uint64_t device);
+    void release(Slot* slot) { slot->active.fetch_sub(1, std::memory_order_release); }
+
+private:
+    unsigned limitFor(uint64_t device) const;
+
+    static constexpr size_t slotCount = 256;
+    unsigned defaultLimit = 0;
+    std::vector<std::pair<uint64_t, unsigned>> overrides;
+    Slot slots[slotCount];
+    Slot overflow; // shared by all devices past slotCount, never limited
+};
+
+// multithreaded directory walker: every thread owns a deque of pending directories,
+// takes work from the back of its own deque and steals from the front of the others
+// once it runs dry, so the tree itself is split between the threads
+class ParallelWalker {
+public:
+    // called for every directory entry; worker is the index of the calling thread
+    using Visitor = std::function<void(unsigned worker, const std::string& directory, const WalkEntry& entry)>;
+    // called when a directory cannot be read
+    using ErrorHandler = std::function<void(const std::string& directory, const std::string& message)>;
+
+    // called with the status of every directory once it is opened; returning a listing
+    // makes the walker use it instead of reading the directory, nullptr reads it as usual
+    using DirectoryHook = std::function<const std::vector<CachedEntry>*(unsigned worker, const DirTask& task, const struct stat& status)>;
+    // called for every subdirectory before it is queued, true skips it and everything below
+    using PruneFilter = std::function<bool(const std::string& path, std::string_view name)>;
+
+    ParallelWalker(unsigned threads, bool recursive, Backend backend, Visitor visitor, ErrorHandler onError);
+    ~ParallelWalker();
+
+    void setDirectoryHook(DirectoryHook hook) { directoryHook = std::move(hook); }
+    void setOrder(Order value) { order = value; }
+    void setPruneFilter(PruneFilter filter) { pruneFilter = std::move(filter); }
+    // -L: descend into symlinks to directories, every directory is read once however it is reached
+    void setFollowSymlinks(bool follow) { followSymlinks = follow; }
+    // -xdev: do not read directories on another device than the root
+    void setSameDevice(bool value) { sameDevice = value; }
+    // at most limit workers read directories of one device at a time (0: no limit), either for
+    // every device or just for device; a directory found to be on a full device is queued again
+    void setDeviceLimit(unsigned limit) { devices.setLimit(limit); }
+    void setDeviceLimit(uint64_t device, unsigned limit) { devices.setLimit(device, limit); }
+    // skip entries ignored by .gitignore / .ignore files, starting with the rules above the root
+    void setIgnoreRules(std::shared_ptr<const IgnoreFrame> rootFrame) { ignoreRoot = std::move(rootFrame); }
+    // entries of the root are at depth 1: only entries from depth minimum on are visited and
+    // no directory is read below depth maximum, 0 means no limit
+    void setDepthLimits(int minimum, int maximum) {
+        minimumDepth = minimum;
+        maximumDepth = maximum;
+    }
+    // --trace: record every directory visit, the recorder needs a buffer per thread
+    void setTrace(TraceRecorder* recorder) { trace = recorder; }
+    // uring backend: operations submitted to the kernel at once, per thread
+    void setUringDepth(unsigned depth) { uringDepth = depth == 0 ? 1 : depth; }
+
+    // walk root with all threads, returns once every directory was visited or the walk was cancelled
+    void run(const std::string& root);
+    // stop the walk early, callable from any thread including visitors; directories still
+    // queued are dropped and threads stop reading at the next entry
+    void cancel();
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+    // one entry per thread, complete once run() returned
+    const std::vector<WalkStatistics>& statistics() const { return counters; }
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<DirTask> tasks;
+    };
+
+    // what the entries of an open directory pass on to their subdirectories
+    struct OpenDirectory {
+        std::shared_ptr<DirHandle> handle; // getdents backend
+        std::shared_ptr<const IgnoreFrame> ignore;
+        uint64_t device;
+    };
+
+    // per thread state of the uring backend
+    struct UringWorker {
+        std::unique_ptr<Uring> ring;
+        std::vector<struct statx> status; // one per ring entry
+        std::vector<const char*> names;   // entries of one getdents chunk that need a lookup, in order
+        std::vector<unsigned char> types; // their DT_* types, DT_UNKNOWN if the lookup failed
+    };
+
+    void work(unsigned worker);
+    // uring backend: opens task and more of the worker's own tasks with one submission, then reads them
+    void visitBatch(unsigned worker, DirTask& task);
+    // the task is done: release its device and take it off pending
+    void finishTask(unsigned worker);
+    // tasks were queued, a device slot came free or the walk is over: wake idle workers
+    void wakeIdle();
+    bool takeTask(unsigned worker, DirTask& task);
+    // a task from the front or back of tasks, with device limits the nearest one whose
+    // device has a free worker
+    bool takeFrom(std::deque<DirTask>& tasks, bool fromFront, unsigned worker, DirTask& task);
+    // fd: the directory opened by openDirectory() (or -errno), unused by the filesystem backend
+    void visitDirectory(unsigned worker, const DirTask& task, int fd);
+    // read the directory and queue its subdirectories, visitDirectory() without tracing
+    void readDirectory(unsigned worker, const DirTask& task, int fd);
+    void readFilesystem(unsigned worker, const DirTask& task, std::vector<DirTask>& subdirectories);
+    void readGetdents(unsigned worker, const DirTask& task, int fd, std::vector<DirTask>& subdirectories);
+    // descriptor of the task's directory, -errno if it cannot be opened
+    int openDirectory(const DirTask& task) const;
+    // where and how a task's directory is opened, shared by openDirectory() and the ring
+    int openFlags(const DirTask& task) const;
+    // uring backend: look up the type of every entry of the getdents chunk that needs it, in one batch
+    void lookupTypes(unsigned worker, int fd, const char* entries, long bytes);
+    // visitor call and subdirectory task for one entry
+    void addEntry(unsigned worker, const DirTask& task, std::string_view name, unsigned char type,
+                  const OpenDirectory& directory, std::vector<DirTask>& subdirectories);
+    // recursion, depth limit and prune filter allow queueing the subdirectory at path
+    bool descendInto(const DirTask& task, const std::string& path, std::string_view name) const;
+    // -L, -xdev and device limits need the status of every opened directory
+    bool needsStatus() const { return followSymlinks || sameDevice || devices.limited(); }
+    // false if the directory with this status is not read now: it was read before (-L), it
+    // is on another device (-xdev), or its device has no free worker and it was queued again
+    bool enterDirectory(unsigned worker, const DirTask& task, const struct stat& status);
+    // entries handed out by the directory hook, if any
+    const std::vector<CachedEntry>* cachedListing(unsigned worker, const DirTask& task, int fd);
+
+    unsigned threadCount;
+    bool recursive;
+    Backend backend;
+    Visitor visitor;
+    ErrorHandler onError;
+    DirectoryHook directoryHook;
+    Order order = Order::DepthFirst;
+    PruneFilter pruneFilter;
+    std::shared_ptr<const IgnoreFrame> ignoreRoot;
+    bool followSymlinks = false;
+    VisitedDirectories visited;
+    bool sameDevice = false;
+    uint64_t rootDevice = 0;
+    DeviceLimiter devices;
+    std::vector<DeviceLimiter::Slot*> deviceSlots; // per worker: the device it is counted for
+    int minimumDepth = 0;
+    int maximumDepth = 0;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::vector<char>> direntBuffers; // one getdents buffer per thread
+    std::vector<WalkStatistics> counters;         // one per thread
+    TraceRecorder* trace = nullptr;
+    unsigned uringDepth = 64;
+    std::vector<UringWorker> urings; // uring backend, one per thread
+    // directories queued or currently being read; the walk is done when this drops to 0
+    std::atomic<size_t> pending{0};
+    std::atomic<bool> cancelled{false};
+    // workers without a task sleep on idleChanged until wakeups moves; queueing a task bumps
+    // wakeups first and then looks at idleWorkers, so one of the two sides always sees the other
+    std::mutex idleLock;
+    std::condition_variable idleChanged;
+    std::atomic<uint64_t> wakeups{0};
+    std::atomic<unsigned> idleWorkers{0};
+    // parent handles kept open by queued tasks; past the budget (half the descriptor limit)
+    // new tasks are opened by their full path instead, which a long breadth-first frontier needs
+    std::atomic<size_t> openHandles{0};
+    size_t handleBudget;
+};
+
+#endif